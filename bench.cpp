@@ -0,0 +1,305 @@
+// Theodore Nowak 08/19/2015
+// A* Search Algorithm
+// Knight Board: benchmark
+
+// Compiling: g++ -std=c++0x -pthread bench.cpp
+// Running: ./a.out [sizes] [--queries n] [--density W=w,L=l,B=b,R=r,T=t] [--seed n] [--jumps]
+
+// The search code is all of knightboard.cpp but its main(). Only this program replaces operator new to count
+// allocations, so knightboard itself keeps the library's allocator
+
+#include <random>
+#include <new>
+#include <sys/resource.h>
+#include <iomanip>
+
+#define KNIGHTBOARD_NO_MAIN
+#include "knightboard.cpp"
+
+// Bytes and blocks handed out by operator new since the program started, to count what a query allocates
+static atomic<uint64_t> allocatedBytes(0);
+static atomic<uint64_t> allocatedBlocks(0);
+
+// Every allocation goes through here (the default operator new[] calls it too), counted and passed on to malloc
+void *operator new(size_t size) {
+	allocatedBytes.fetch_add(size, memory_order_relaxed);
+	allocatedBlocks.fetch_add(1, memory_order_relaxed);
+	void *p = malloc(size ? size : 1);
+	if (p == NULL) {
+		throw bad_alloc();
+	}
+	return p;
+}
+
+// Kept out of line so the compiler never sees free() called straight on what operator new returned
+__attribute__((noinline)) void operator delete(void *p) noexcept {
+	free(p);
+}
+
+// With sized deallocation (C++14 on) the sized form has to be replaced as well, or it goes to the library's
+#ifdef __cpp_sized_deallocation
+__attribute__((noinline)) void operator delete(void *p, size_t) noexcept {
+	free(p);
+}
+#endif
+
+// Chance of each location of a generated board (see generateBoard()) being each kind of terrain
+struct BoardDensity {
+	double water;
+	double lava;
+	double blocker;
+	double rock;
+	double teleport;
+};
+
+// Fill in map (a new Map, with no portal lines) as a width x height board at random: each location is independently
+// water, lava, blocker, rock or teleport with the chance given in density and plain otherwise, then the start and end
+// go on two different plain locations (if there are two). The same seed always gives the same board
+void generateBoard(Map &map, int w, int h, const BoardDensity &density, uint32_t seed) {
+
+	mt19937 random(seed);
+	const char terrain[5] = {'W', 'L', 'B', 'R', 'T'};
+	const double chance[5] = {density.water, density.lava, density.blocker, density.rock, density.teleport};
+
+	// Cumulative thresholds on a 32-bit draw, so each location takes one draw and no floating point
+	uint64_t threshold[5];
+	double total = 0;
+	for (int t = 0; t < 5; t++) {
+		total += max(0.0, chance[t]);
+		threshold[t] = (uint64_t)(min(total, 1.0)*4294967296.0);
+	}
+
+	map.width = w;
+	map.height = h;
+	map.map.assign((size_t)w*h, '.');
+	for (size_t k = 0; k < map.map.size(); k++) {
+		uint64_t draw = random();
+		for (int t = 0; t < 5; t++) {
+			if (draw < threshold[t]) {
+				map.map[k] = terrain[t];
+				break;
+			}
+		}
+	}
+
+	for (int placed = 0, tries = 0; placed < 2 && tries < 1000; tries++) {
+		size_t k = random() % map.map.size();
+		if (map.map[k] == '.') {
+			map.map[k] = placed++ == 0 ? 'S' : 'E';
+		}
+	}
+
+	map.build();
+}
+
+// Measure search() on generated boards of each size (see generateBoard()), every board and query drawn from seed
+// Each query is searched, its route traced and checked by verifySequence() (and on boards with portals, its cost against
+// a uniform-cost search()), and one line per size reports the latency percentiles, nodes expanded per second of search(),
+// heap bytes allocated per query (the first query, which sizes the search state, is left out) and the peak resident set
+// so far. Afterwards the queries go through one RouteCache on this board and a twin, whose answers are checked too.
+// Returns false if any route fails its check
+// With jumps the searches jump across uniform regions (see SearchState::jumps)
+bool runBenchmark(const vector<int> &sizes, int queries, const BoardDensity &density, uint32_t seed, bool jumps) {
+
+	cout << setw(6) << "size" << setw(9) << "build ms" << setw(8) << "queries" << setw(7) << "found"
+		 << setw(11) << "p50 us" << setw(11) << "p90 us" << setw(11) << "p99 us" << setw(11) << "max us"
+		 << setw(13) << "nodes/s" << setw(13) << "bytes/query" << setw(14) << "allocs/query" << setw(13) << "peak RSS MB" << "\n";
+
+	bool valid = true;
+	for (size_t s = 0; s < sizes.size(); s++) {
+
+		int size = sizes[s];
+		Map map;
+		chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+		generateBoard(map, size, size, density, seed + s);
+		chrono::steady_clock::time_point t1 = chrono::steady_clock::now();
+
+		// Query end points are any two locations a knight can stand on
+		mt19937 random(seed ^ 0x9e3779b9u ^ (uint32_t)size);
+		vector<int> open;
+		for (int k = 0; k < size*size; k++) {
+			if (map.map[k] != 'B' && map.map[k] != 'R') {
+				open.push_back(k);
+			}
+		}
+
+		SearchState state;
+		SearchState plain;
+		state.jumps = jumps;
+		vector<Node> total_path;
+		vector<double> latency;
+		latency.reserve(queries);
+		long long expanded = 0;
+		double searching = 0;
+		uint64_t bytes = 0;
+		uint64_t blocks = 0;
+		int found = 0;
+		vector<Query> asked;
+		asked.reserve(queries);
+
+		for (int q = 0; q < queries && !open.empty(); q++) {
+
+			int from = open[random() % open.size()];
+			int to = open[random() % open.size()];
+			asked.push_back(Query(from % size, from / size, to % size, to / size));
+			uint64_t bytes0 = allocatedBytes.load(memory_order_relaxed);
+			uint64_t blocks0 = allocatedBlocks.load(memory_order_relaxed);
+
+			chrono::steady_clock::time_point q0 = chrono::steady_clock::now();
+			bool reached = search(map, state, from % size, from / size, to % size, to / size);
+			chrono::steady_clock::time_point searched = chrono::steady_clock::now();
+			if (reached) {
+				tracePath(map, state, total_path);
+				if (!verifySequence(total_path, map, false)) {
+					cerr << "Route " << q << " on the " << size << "x" << size << " board failed its check\n";
+					valid = false;
+				}
+				found++;
+			}
+			chrono::steady_clock::time_point q1 = chrono::steady_clock::now();
+
+			latency.push_back(chrono::duration<double, micro>(q1 - q0).count());
+			searching += chrono::duration<double, micro>(searched - q0).count();
+			expanded += state.expanded;
+			if (q > 0) {
+				bytes += allocatedBytes.load(memory_order_relaxed) - bytes0;
+				blocks += allocatedBlocks.load(memory_order_relaxed) - blocks0;
+			}
+
+			// With portals the estimate can grow the most in a move, and the open list has to span that,
+			// so there the cost is checked against a uniform-cost search too (untimed)
+			if (map.hasPortals()) {
+				bool plainReached = search(map, plain, from % size, from / size, to % size, to / size, false);
+				if (plainReached != reached || (reached && plain.getFinalCost() != state.getFinalCost())) {
+					cerr << "Route " << q << " on the " << size << "x" << size << " board costs "
+						 << (reached ? state.getFinalCost() : -1) << ", uniform-cost search finds "
+						 << (plainReached ? plain.getFinalCost() : -1) << "\n";
+					valid = false;
+				}
+			}
+		}
+
+		// One RouteCache shared by engines on two boards of the same size has to answer each from its own board:
+		// fill it with the queries on this board, then check what it answers on a twin board against search() there
+		Map twin;
+		generateBoard(twin, size, size, density, ~(seed + s));
+		RouteCache cache(queries, (size_t)queries*2*size);
+		QueryEngine engine(1);
+		engine.setCache(&cache);
+		vector<QueryResult> results;
+		engine.run(map, asked, results);
+		engine.run(twin, asked, results);
+		for (size_t q = 0; q < asked.size(); q++) {
+			bool reached = search(twin, plain, asked[q].startx, asked[q].starty, asked[q].endx, asked[q].endy);
+			if (reached != results[q].found || (reached && plain.getFinalCost() != results[q].cost)) {
+				cerr << "Route " << q << " on the twin " << size << "x" << size << " board costs "
+					 << (results[q].found ? results[q].cost : -1) << " through the shared cache, search finds "
+					 << (reached ? plain.getFinalCost() : -1) << "\n";
+				valid = false;
+			}
+		}
+
+		sort(latency.begin(), latency.end());
+		int n = latency.size();
+		int measured = max(1, n - 1);
+		struct rusage usage;
+		getrusage(RUSAGE_SELF, &usage);
+
+		// Nearest-rank percentiles
+		double percentile[3] = {0, 0, 0};
+		const double rank[3] = {0.50, 0.90, 0.99};
+		for (int p = 0; p < 3 && n > 0; p++) {
+			percentile[p] = latency[min(n - 1, (int)ceil(rank[p]*n) - 1)];
+		}
+
+		cout << fixed << setprecision(1)
+			 << setw(6) << size << setw(9) << chrono::duration<double, milli>(t1 - t0).count()
+			 << setw(8) << n << setw(7) << found
+			 << setw(11) << percentile[0] << setw(11) << percentile[1] << setw(11) << percentile[2]
+			 << setw(11) << (n > 0 ? latency[n-1] : 0.0)
+			 << setprecision(0) << setw(13) << (searching > 0 ? expanded/(searching/1e6) : 0.0)
+			 << setw(13) << (double)bytes/measured << setprecision(2) << setw(14) << (double)blocks/measured
+			 << setprecision(1) << setw(13) << usage.ru_maxrss/1024.0 << "\n" << flush;
+	}
+	return valid;
+}
+
+// Usage: bench [sizes] [--queries n] [--density W=w,L=l,B=b,R=r,T=t] [--seed n] [--jumps]
+// Boards of each comma-separated size (32,128,512,2048 by default, each size x size) are generated with the given chance
+// of each terrain (W=0.1,L=0.05,B=0.05,R=0.05,T=0 by default) and n random queries (100 by default) are timed on each,
+// see runBenchmark(). With --jumps the searches jump across uniform regions of plain ground (see SearchState::jumps).
+// Returns 1 if any route fails its check
+int main(int argc, char *argv[]) {
+
+	vector<int> sizes;
+	int queries = 100;
+	BoardDensity density = {0.10, 0.05, 0.05, 0.05, 0.0};
+	uint32_t seed = 1;
+	bool jumps = false;
+
+	for (int a = 1; a < argc; a++) {
+		string arg = argv[a];
+		if (arg == "--queries" && a+1 < argc) {
+			queries = atoi(argv[++a]);
+		}
+		else if (arg == "--seed" && a+1 < argc) {
+			seed = strtoul(argv[++a], NULL, 10);
+		}
+		else if (arg == "--jumps") {
+			jumps = true;
+		}
+		else if (arg == "--density" && a+1 < argc) {
+			istringstream fields(argv[++a]);
+			string entry;
+			while (getline(fields, entry, ',')) {
+				double chance = atof(entry.c_str() + min(entry.size(), (size_t)2));
+				if (entry.size() < 3 || entry[1] != '=' || chance < 0 || chance > 1) {
+					cerr << "Bad terrain density " << entry << "\n";
+					return(1);
+				}
+				if (entry[0] == 'W') {
+					density.water = chance;
+				}
+				else if (entry[0] == 'L') {
+					density.lava = chance;
+				}
+				else if (entry[0] == 'B') {
+					density.blocker = chance;
+				}
+				else if (entry[0] == 'R') {
+					density.rock = chance;
+				}
+				else if (entry[0] == 'T') {
+					density.teleport = chance;
+				}
+				else {
+					cerr << "Bad terrain density " << entry << "\n";
+					return(1);
+				}
+			}
+		}
+		else if (arg.size() > 1 && arg[0] == '-' && arg[1] == '-') {
+			cerr << "Unknown option " << arg << "\n";
+			return(1);
+		}
+		else {
+			istringstream fields(arg);
+			string size;
+			while (getline(fields, size, ',')) {
+				if (atoi(size.c_str()) <= 0 || (long long)atoi(size.c_str())*atoi(size.c_str()) > (long long)PARENT_INDEX + 1) {
+					cerr << "Bad board size " << size << "\n";
+					return(1);
+				}
+				sizes.push_back(atoi(size.c_str()));
+			}
+		}
+	}
+	if (sizes.empty()) {
+		sizes.push_back(32);
+		sizes.push_back(128);
+		sizes.push_back(512);
+		sizes.push_back(2048);
+	}
+
+	return runBenchmark(sizes, queries, density, seed, jumps) ? 0 : 1;
+}
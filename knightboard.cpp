@@ -2,15 +2,18 @@
 // A* Search Algorithm
 // Knight Board
 
-// Compiling: g++ -std=c++0x
+// Compiling: g++ -std=c++0x -pthread
 // gcc version 4.6.3 (Ubuntu/Linaro 4.6.3-1ubuntu5)
 
+// Running: ./a.out maps/bmap.txt (or pipe a map in on stdin)
+
 /* Code satisfying all 5 levels of challenge
-** Level 1: Refer to verifySequence() at line 522
-** Level 2: Refer to search() at line 369
-** Level 3: Refer to search() at line 369
+** Level 1: Refer to verifySequence()
+** Level 2: Refer to search()
+** Level 3: Refer to search()
 ** Level 4: Refer to everything
-** Level 5: Refer to everything and note prioritizeShortest() and prioritizeLongest() lines 319, 328
+** Level 5: Refer to LongestPath (run with --longest), which replaced the max-first prioritizeLongest() swap
+**          since that never gave the longest simple path anyway
 **
 ** Description:
 ** To complete this challenge I implemented an A* breadth-based search algorithm in order to find the shortest path to the end goal. It does
@@ -36,75 +39,61 @@
 #include <string>
 #include <math.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
 #include <array>
 #include <queue>
 #include <vector>
 #include <iostream>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <chrono>
+#include <atomic>
+#include <climits>
+#include <cassert>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 using namespace std;
 
 // Maps available for input
 // ******************************************************************************************************************************************************************************************************
-
-/*
-// Small Map, comment out to use bigger map (bmap)
-static const int n = 8;
-static char smap [n][n] = {
-
-	// 0    1    2    3    4    5    6    7
-	 {'.', '.', '.', '.', '.', '.', '.', '.'}, // 0
-	 {'.', '.', '.', '.', '.', '.', '.', '.'}, // 1
-	 {'.', 'S', '.', '.', '.', '.', '.', '.'}, // 2
-	 {'.', '.', '.', '.', '.', '.', '.', '.'}, // 3
-	 {'.', '.', '.', '.', '.', 'E', '.', '.'}, // 4
-	 {'.', '.', '.', '.', '.', '.', '.', '.'}, // 5
-	 {'.', '.', '.', '.', '.', '.', '.', '.'}, // 6
-	 {'.', '.', '.', '.', '.', '.', '.', '.'}  // 7
-
-};
-*/
-
-
-
-// Big Map, comment out to use smaller map (smap)
-static const int n = 32;
-static char bmap[n][n] = {
-
-   // 0    1    2    3    4    5    6    7    8    9    10    11    12    13   14    15    16    17    18    19    20    21    22    23    24    25   26    27    28    29    30    31
-	{'.', '.', '.', '.', '.', '.', '.', '.', 'B', '.', '.',  '.',  'L',  'L', 'L',  '.',  '.',  '.',  '.',  '.',  '.',  '.',  '.',  '.',  '.',  '.', '.',  '.',  '.',  '.',  '.',  '.'}, // 0
-	{'.', '.', '.', '.', '.', '.', '.', '.', 'B', '.', '.',  '.',  'L',  'L', 'L',  '.',  '.',  '.',  '.',  '.',  '.',  '.',  '.',  '.',  '.',  '.', '.',  '.',  '.',  '.',  '.',  '.'}, // 1
-	{'.', '.', '.', '.', '.', '.', '.', '.', 'B', '.', '.',  '.',  'L',  'L', 'L',  '.',  '.',  '.',  'L',  'L',  'L',  '.',  '.',  '.',  '.',  '.', '.',  '.',  '.',  '.',  '.',  '.'}, // 2
-	{'.', '.', '.', '.', '.', '.', '.', '.', 'B', '.', '.',  '.',  'L',  'L', 'L',  '.',  '.',  'L',  'L',  'L',  '.',  '.',  '.',  'R',  'R',  '.', '.',  '.',  '.',  '.',  '.',  '.'}, // 3
-	{'.', '.', '.', '.', '.', '.', '.', '.', 'B', '.', '.',  '.',  'L',  'L', 'L',  'L',  'L',  'L',  'L',  'L',  '.',  '.',  '.',  'R',  'R',  '.', '.',  '.',  '.',  '.',  '.',  '.'}, // 4
-	{'.', '.', '.', '.', '.', '.', '.', '.', 'B', '.', '.',  '.',  'L',  'L', 'L',  'L',  'L',  'L',  '.',  '.',  '.',  '.',  '.',  '.',  '.',  '.', '.',  '.',  '.',  '.',  '.',  '.'}, // 5
-	{'.', '.', '.', '.', '.', '.', '.', '.', 'B', '.', '.',  '.',  '.',  '.', '.',  '.',  '.',  '.',  '.',  '.',  '.',  'R',  'R',  '.',  '.',  '.', '.',  '.',  '.',  '.',  '.',  '.'}, // 6
-	{'.', '.', '.', '.', '.', '.', '.', '.', 'B', 'B', '.',  '.',  '.',  '.', '.',  '.',  '.',  '.',  '.',  '.',  '.',  'R',  'R',  '.',  '.',  '.', '.',  '.',  '.',  '.',  '.',  '.'}, // 7
-	{'.', '.', '.', '.', '.', '.', '.', '.', 'W', 'B', 'B',  '.',  '.',  '.', '.',  '.',  '.',  '.',  '.',  '.',  '.',  '.',  '.',  '.',  '.',  '.', '.',  '.',  '.',  '.',  '.',  '.'}, // 8
-	{'.', '.', '.', 'R', 'R', '.', '.', '.', 'W', 'W', 'B',  'B',  'B',  'B', 'B',  'B',  'B',  'B',  'B',  'B',  '.',  '.',  '.',  '.',  '.',  '.', '.',  '.',  '.',  '.',  '.',  '.'}, // 9
-	{'.', '.', '.', 'R', 'R', '.', '.', '.', 'W', 'W', '.',  '.',  '.',  '.', '.',  '.',  '.',  '.',  '.',  'B',  '.',  '.',  '.',  '.',  '.',  '.', '.',  '.',  '.',  '.',  '.',  '.'}, // 10
-	{'.', '.', '.', '.', '.', '.', '.', '.', 'W', 'W', '.',  '.',  '.',  '.', '.',  '.',  '.',  '.',  '.',  'B',  '.',  '.',  '.',  '.',  '.',  '.', 'T',  '.',  '.',  '.',  '.',  '.'}, // 11
-	{'.', '.', '.', 'w', 'W', 'W', 'W', 'W', 'W', 'W', '.',  '.',  '.',  '.', '.',  '.',  '.',  '.',  '.',  'B',  '.',  '.',  '.',  '.',  '.',  '.', '.',  '.',  '.',  '.',  '.',  '.'}, // 12
-	{'.', '.', '.', 'w', 'W', 'W', 'W', 'W', 'W', 'W', '.',  '.',  '.',  '.', '.',  '.',  '.',  '.',  '.',  'B',  '.',  '.',  'R',  'R',  '.',  '.', '.',  '.',  '.',  '.',  '.',  '.'}, // 13
-	{'.', '.', '.', 'W', 'W', '.', '.', '.', '.', '.', '.',  '.',  '.',  '.', '.',  'B',  'B',  'B',  'B',  'B',  '.',  '.',  'R',  'R',  '.',  'W', 'W',  'W',  'W',  'W',  'W',  'W'}, // 14
-	{'.', '.', '.', 'W', 'W', '.', '.', '.', '.', '.', '.',  '.',  '.',  '.', '.',  'B',  '.',  '.',  '.',  '.',  '.',  '.',  '.',  '.',  '.',  'W', '.',  '.',  '.',  '.',  '.',  '.'}, // 15
-	{'W', 'W', 'W', 'W', '.', '.', '.', '.', '.', '.', '.',  '.',  '.',  '.', '.',  'B',  'S',  '.',  '.',  'W',  'W',  'W',  'W',  'W',  'W',  'W', '.',  '.',  '.',  '.',  '.',  '.'}, // 16
-	{'.', '.', '.', 'W', 'W', 'W', 'W', 'W', 'W', 'W', '.',  '.',  '.',  '.', '.',  'B',  '.',  '.',  '.',  '.',  '.',  '.',  '.',  '.',  '.',  '.', '.',  '.',  'B',  'B',  'B',  'B'}, // 17
-	{'.', '.', '.', 'W', 'W', 'W', 'W', 'W', 'W', 'W', '.',  '.',  '.',  '.', '.',  'B',  'B',  'B',  '.',  '.',  '.',  '.',  '.',  '.',  '.',  '.', '.',  '.',  'B',  '.',  '.',  '.'}, // 18
-	{'.', '.', '.', 'W', 'W', 'W', 'W', 'W', 'W', 'W', '.',  '.',  '.',  '.', '.',  '.',  '.',  'B',  'W',  'W',  'W',  'W',  'W',  'W',  'B',  'B', 'B',  'B',  'B',  '.',  '.',  '.'}, // 19
-	{'.', '.', '.', 'W', 'W', 'W', 'W', 'W', 'W', 'W', '.',  '.',  '.',  '.', '.',  '.',  '.',  'B',  'W',  'W',  'W',  'W',  'W',  'W',  'B',  '.', '.',  '.',  '.',  '.',  '.',  '.'}, // 20
-	{'.', '.', '.', '.', '.', '.', '.', '.', '.', '.', '.',  'B',  'B',  'B', '.',  '.',  '.',  '.',  '.',  '.',  '.',  '.',  '.',  '.',  'B',  'B', '.',  '.',  '.',  '.',  '.',  '.'}, // 21
-	{'.', '.', '.', '.', '.', 'R', 'R', '.', '.', '.', '.',  'B',  '.',  '.', '.',  '.',  '.',  '.',  '.',  '.',  '.',  '.',  '.',  '.',  '.',  'B', '.',  '.',  '.',  '.',  '.',  '.'}, // 22
-	{'.', '.', '.', '.', '.', 'R', 'R', '.', '.', '.', '.',  'B',  '.',  '.', '.',  '.',  '.',  '.',  '.',  '.',  '.',  '.',  '.',  '.',  '.',  'B', '.',  'T',  '.',  '.',  '.',  '.'}, // 23
-	{'.', '.', '.', '.', '.', '.', '.', '.', '.', '.', '.',  'B',  '.',  '.', '.',  '.',  '.',  'R',  'R',  '.',  '.',  '.',  '.',  '.',  '.',  'B', '.',  '.',  '.',  '.',  '.',  '.'}, // 24
-	{'.', '.', '.', '.', '.', '.', '.', '.', '.', '.', '.',  'B',  '.',  '.', '.',  '.',  '.',  'R',  'R',  '.',  '.',  '.',  '.',  '.',  '.',  '.', '.',  '.',  '.',  'E',  '.',  '.'}, // 25
-	{'.', '.', '.', '.', '.', '.', '.', '.', '.', '.', '.',  'B',  '.',  '.', '.',  '.',  '.',  '.',  '.',  '.',  '.',  '.',  '.',  '.',  '.',  '.', '.',  '.',  '.',  '.',  '.',  '.'}, // 26
-	{'.', '.', '.', '.', '.', '.', '.', '.', '.', '.', '.',  'B',  '.',  '.', '.',  '.',  '.',  '.',  '.',  '.',  '.',  '.',  '.',  '.',  '.',  '.', '.',  '.',  '.',  '.',  '.',  '.'}, // 27
-	{'.', '.', '.', '.', '.', '.', '.', '.', '.', '.', '.',  'B',  '.',  '.', '.',  '.',  '.',  '.',  '.',  '.',  '.',  '.',  '.',  '.',  '.',  '.', '.',  '.',  '.',  '.',  '.',  '.'}, // 28
-	{'.', '.', '.', '.', '.', '.', '.', '.', '.', '.', '.',  'B',  '.',  '.', '.',  '.',  '.',  '.',  '.',  '.',  '.',  '.',  '.',  '.',  '.',  '.', '.',  '.',  '.',  '.',  '.',  '.'}, // 29
-	{'.', '.', '.', '.', '.', '.', '.', '.', '.', '.', '.',  'B',  '.',  '.', '.',  '.',  '.',  '.',  '.',  '.',  '.',  '.',  'R',  'R',  '.',  '.', '.',  '.',  '.',  '.',  '.',  '.'}, // 30
-	{'.', '.', '.', '.', '.', '.', '.', '.', '.', '.', '.',  'B',  '.',  '.', '.',  '.',  '.',  '.',  '.',  '.',  '.',  '.',  'R',  'R',  '.',  '.', '.',  '.',  '.',  '.',  '.',  '.'}, // 31
-};
-
+// Maps are read at run time from a text file (or stdin), one row of terrain characters per line:
+//
+//	'.' plain (cost 1), 'W' water (cost 2), 'L' lava (cost 5), 'B' blocker, 'R' rock, 'T' teleport,
+//	'S' start, 'E' end
+//
+// Every row must have the same width. maps/bmap.txt is the original 32x32 board, maps/smap.txt the small 8x8 one.
+// A knight landing on a teleport is carried through a portal to its exit. Portals can be given after the rows:
+//
+//	portal x1 y1 x2 y2 [oneway]
+//
+// which links the 'T' at (x1, y1) to (x2, y2), and back again unless it is oneway (the exit of a oneway portal
+// can be any location a knight can stand on). The 'T's no portal line names are paired up two by two in row order.
+//
+// Routes can be written out for other tools instead of drawn (see writeRouteCsv() and writeRouteBinary()):
+//
+//	CSV: a "x,y" header line, then one "x,y" line per location, start first
+//	Binary: "KBRT", then little-endian uint32 width, height, location count and int32 cost,
+//	        then one uint32 location index (y*width + x) per location, start first
+//
+// Big boards load much faster from the binary board format (see BoardHeader), written from any map with --convert.
+// After the header come width*height bytes each of terrain characters, costs, move table and reverse move table,
+// then the portals in use and the portal lines, as little-endian uint32 (entry, exit) location index pairs.
+// Everything a text map has to work out as it loads is stored, so loading is a memory map, one pass of checks
+// over the mapped file and a bulk copy of each table. The mapping only saves the text parsing: the Map still owns
+// (and setChar() still edits) its own copy of every table, so the board is copied once and the file unmapped
 // *******************************************************************************************************************************************************************************************************
 
 
@@ -115,464 +104,5941 @@ static const int dirmap[8][2] = {
 	{-2,-1}, {-1,-2}, {1,-2}, {2,-1}
 };
 
-// Class containing map manipulation functions and map characteristic variables
-class Map  {
-
-private:
-	int start[2]; // Start point on map
-	int end[2]; // End point on map
-	int final[3]; // Final destination of search, if success should = end
-
-	// Variables to handle teleport locations ('T')
-	bool T1;
-	int t1[2];
-	bool T2;
-	int t2[2];
+// Node structure for locations along a route
+typedef struct Node Node;
 
-public:
+struct Node {
 
-	int size; // Size of map
-	char map[n][n]; // Local copy of chosen map
-
-	// Open Map: Map of all locations that have been added to the priority queue
-	// Closed Map: Map of all locations that have been at the top of the priority queue and popped
-	// Cost Map: Map of the cost to move to each location on the map
-	// Parent Element X: The X coordinate of the location that came before the current one (used to find route back)
-	// Parent Element Y: The Y coordinate of the location that came before the current one (used to find route back)
-	// ********************************************************************************************
-	// [0]: Open Map, [1]: Closed Map, [2]: Cost Map, [3]: Parent Element X, [4]: Parent Element Y
-	// ********************************************************************************************
-	int mapData[n][n][5];
-
-	// Initialize a map class with the map and its size
-	Map(int msize, char tmap[n][n]) {
-		
-		size = msize;
+	int x; // Position x
+	int y; // Position y
+	int cost; // Cost of moving to space
 
-		// Initialize default (nonexistence) values for T1 and T2 teleport locations
-		t1[0] = -1;
-		t1[1] = -1;
-		t2[0] = -1;
-		t2[1] = -1;
-		T1 = false;
-		T2 = false;
+	// Default constructor
+	Node() {} 
 
-		// Initialize final values as absurd to know if none are assigned
-		final[0] = -1;
-		final[1] = -1;
-		final[2] = 0;
+	Node(int xpos, int ypos) {
+		x = xpos; // Set initialized x
+		y = ypos; // Set initialized y
+		cost = 0; // Set default cost of initialized node to 0: Will be overwritten 
+	}
 
+	Node(int xpos, int ypos, int Cost)  {
+		x = xpos;
+		y = ypos;
+		cost = Cost;
+	}
+};
 
-		// Create local copy of map and initialize all mapData to starting states
-		for (int i = 0; i < size; i++) {
-			for (int j = 0; j < size; j++) {
-				map[j][i] = tmap[j][i];
-				mapData[j][i][0] = 0;
-				mapData[j][i][1] = 0;
-				mapData[j][i][2] = 1;
-				mapData[j][i][3] = 0;
-				mapData[j][i][4] = 0;
-			}
-		}
+// Minimum number of knight moves between two points on an unbounded, unobstructed board
+// Never more than the moves needed on a real map, so it is a safe lower bound to search with
+int knightDistance(int dx, int dy) {
 
-		// Run through map and update all mapData information
-		for (int i = 0; i < size; i++) {
-			for (int j = 0; j < size; j++) {
+	dx = abs(dx);
+	dy = abs(dy);
+	if (dx < dy) {
+		int temp = dx;
+		dx = dy;
+		dy = temp;
+	}
 
-				// Set start point, and make start cost 0
-				if (map[j][i] == 'S') {
-					start[0] = i;
-					start[1] = j;
-					mapData[j][i][2] = 0;
-				}
+	// The two exceptions to the closed form, both right next to the origin
+	if (dx == 1 && dy == 0) {
+		return 3;
+	}
+	if (dx == 2 && dy == 2) {
+		return 4;
+	}
 
-				// Set end point (remain cost of 1 to move there)
-				if (map[j][i] == 'E') {
-					end[0] = i;
-					end[1] = j;
-				}
+	int delta = dx - dy;
+	if (dy > delta) {
+		return delta + 2*((dy - delta + 2)/3);
+	}
+	return delta - 2*((delta - dy)/4);
+}
 
-				// Set water movement cost 2
-				if (map[j][i] == 'W') {
-					mapData[j][i][2] = 2;
-				}
+// Move sets for searchMoves(), each a piece's 8 steps as constexpr (dx, dy) pairs, and distance(dx, dy): the
+// fewest steps that could cover (dx, dy) on an open board, which is never too many and changes by at most one a step.
+// tabled is true for the knight moves in dirmap order, which the Map's own move tables already hold.
+// footprint is the most locations the footprint of one step can have (see moveFootprint())
 
-				// Set lava movement cost 5
-				if (map[j][i] == 'L') {
-					mapData[j][i][2] = 5;
-				}
+// The leaper that jumps A one way and B the other (0 < A < B) in any of the 8 directions, in dirmap order
+template <int A, int B>
+struct Leaper {
 
-				// Find and define the teleport points
-				if (map[j][i] == 'T') {
-					if (!T1) {
-						t1[0] = i;
-						t1[1] = j;
-						T1 = true;
-					}
-					else {
-						t2[0] = i;
-						t2[1] = j;
-						T2 = true;
-					}
-				}
-			}
-		}
+	static constexpr bool tabled = (A == 1 && B == 2);
+	static constexpr int footprint = B*(A + 1);
+	static constexpr int steps[8][2] = {
+		{B,A}, {A,B}, {-A,B}, {-B,A},
+		{-B,-A}, {-A,-B}, {A,-B}, {B,-A}
+	};
 
+	// A step covers at most B along either axis and A + B along both together
+	static int distance(int dx, int dy) {
+		int far = max(abs(dx), abs(dy));
+		int sum = abs(dx) + abs(dy);
+		return max((far + B - 1)/B, (sum + A + B - 1)/(A + B));
 	}
+};
 
-	// Various map get functions
-	int getStartX() {return start[0];}
-	int getStartY() {return start[1];}
-	int getEndX() {return end[0];}
-	int getEndY() {return end[1];}
-	int getT1X() {return t1[0];}
-	int getT1Y() {return t1[1];}
-	int getT2X() {return t2[0];}
-	int getT2Y() {return t2[1];}
-	int getFinalX() {return final[0];}
-	int getFinalY() {return final[1];}
-	int getFinalCost() {return final[2];}
-
-	char getChar(int x, int y) {return map[y][x];}
-
-	int getOpen(int x, int y) {return mapData[y][x][0];}
-	int getClosed(int x, int y) {return mapData[y][x][1];}
-	int getCost(int x, int y) {return mapData[y][x][2];}
-	int getParentX(int x, int y) {return mapData[y][x][3];}
-	int getParentY(int x, int y) {return mapData[y][x][4];}
+template <int A, int B> constexpr int Leaper<A, B>::steps[8][2];
 
-	// Set the final location of the route
-	void setFinal(int x, int y, int cost) {
-		final[0] = x;
-		final[1] = y;
-		final[2] = cost;
-	}
+typedef Leaper<1, 2> Knight;
+typedef Leaper<1, 3> Camel;
+typedef Leaper<2, 3> Zebra;
 
-	// Set functions for various map data elements
-	void setChar(int x, int y, char Char) {
-		map[y][x] = Char;
-	}
+// The knight has an exact closed form
+template <> inline int Leaper<1, 2>::distance(int dx, int dy) {
+	return knightDistance(dx, dy);
+}
 
-	void addToOpen(int x, int y) {
-		mapData[y][x][0] = 1;
-	}
+// One step in any of the 8 directions
+struct King {
 
-	void addToClosed(int x, int y) {
-		mapData[y][x][1] = 1;
-	}
+	static constexpr bool tabled = false;
+	static constexpr int footprint = 2;
+	static constexpr int steps[8][2] = {
+		{1,0}, {1,1}, {0,1}, {-1,1},
+		{-1,0}, {-1,-1}, {0,-1}, {1,-1}
+	};
 
-	void setCost(int x, int y, int Cost) {
-		mapData[y][x][2] = Cost;
+	static int distance(int dx, int dy) {
+		return max(abs(dx), abs(dy));
 	}
+};
 
-	void setParent(int x, int y, int px, int py) {
-		mapData[y][x][3] = px;
-		mapData[y][x][4] = py;
-	}
+constexpr int King::steps[8][2];
 
-	// Prints information about the map
-	void printMapStats() {
-		cout << "Start Point (X, Y): (" << getStartX() << ", " << getStartY() << ")\n";
-		cout << "End Point (X, Y): (" << getEndX() << ", " << getEndY() << ")\n";
-		cout << "Teleporter 1 (X, Y): (" << getT1X() << ", " << getT1Y() << ")\n";
-		cout << "Teleporter 1 (X, Y): (" << getT2X() << ", " << getT2Y() << ")\n";
-		cout << "Map Size (N, N): (" << size << ", " << size << ")\n";
-	}
+// The locations a step of (dx, dy) passes over, relative to where it starts: the rectangle between its two ends
+// less the side the step sets off along, moving along the longer axis first. A 'B' on any of them blocks the step.
+// For a knight move that is the same four locations Map::moveBlocked() checks.
+// Fills cells and returns how many there are
+int moveFootprint(int dx, int dy, int cells[][2]) {
 
-	// Print the entire map
-	void printMap() {
-		for (int j = 0; j < size; j++) {
-			for (int i = 0; i < size; i++) {
-				cout << map[j][i];
-			}
-			cout << '\n';
-		}
-	}
+	int sx = dx > 0 ? 1 : -1;
+	int sy = dy > 0 ? 1 : -1;
+	int n = 0;
 
-	// Print the entire cost map
-	void printCostMap() {
-		for (int j = 0; j < size; j++) {
-			for (int i = 0; i < size; i++) {
-				cout << mapData[j][i][2];
+	if (abs(dx) >= abs(dy)) {
+		for (int j = 1; j <= abs(dx); j++) {
+			for (int k = 0; k <= abs(dy); k++) {
+				cells[n][0] = j*sx;
+				cells[n][1] = k*sy;
+				n++;
 			}
-			cout << '\n';
 		}
 	}
-
-	// Print the entire map that has been searched
-	void printClosedMap() {
-		for (int j = 0; j < n; j++) {
-			for (int i = 0; i < n; i++) {
-				cout << mapData[j][i][1];
+	else {
+		for (int k = 1; k <= abs(dy); k++) {
+			for (int j = 0; j <= abs(dx); j++) {
+				cells[n][0] = j*sx;
+				cells[n][1] = k*sy;
+				n++;
 			}
-			cout << '\n';
 		}
 	}
+	return n;
+}
+
+// What a route is made cheapest in
+enum Objective {
+	CHEAPEST, // Least total cost of the locations moved to (the default)
+	FEWEST_MOVES // Least number of moves, whatever the terrain
 };
 
-// Node structure to use in our priority queue
-typedef struct Node Node;
+// A one-way portal: a knight landing on entry ends up standing on exit, for the cost of landing on entry
+struct Portal {
+	int entry; // Location index of the teleport landed on
+	int exit; // Location index ended up on
+	int nextArrival; // Next portal with the same exit, -1 for the last
+};
 
-struct Node {
+// A parent map entry is normally the index of the location before. A location reached through a portal has
+// VIA_PORTAL set, the move onto the portal entry (its dirmap index) in the next three bits, and the location
+// the move was made from in the rest, which limits maps to 2^28 locations
+static const uint32_t VIA_PORTAL = 0x80000000u;
+static const uint32_t PARENT_INDEX = 0x0fffffffu;
 
-	int x; // Position x
-	int y; // Position y
-	int cost; // Priority/Cost of moving to space
+// Parent map entry for moving from location k by dirmap[move] onto a portal entry
+uint32_t portalParent(int k, int move) {
+	return VIA_PORTAL | (uint32_t)move << 28 | k;
+}
 
-	// Default constructor
-	Node() {} 
+// Header of the binary board format, all fields little-endian
+struct BoardHeader {
+	char magic[4]; // "KBMP"
+	uint32_t version; // BOARD_VERSION
+	uint32_t width;
+	uint32_t height;
+	uint32_t portals; // Number of portals in use
+	uint32_t declared; // Number of portal lines, one way each
+	int32_t start; // Location index of the start ('S'), -1 if none
+	int32_t end; // Location index of the end ('E'), -1 if none
+	uint32_t minCost;
+	uint32_t maxCost;
+};
 
-	Node(int xpos, int ypos) {
-		x = xpos; // Set initialized x
-		y = ypos; // Set initialized y
-		cost = 0; // Set default cost of initialized node to 0: Will be overwritten 
-	}
+static const uint32_t BOARD_VERSION = 1;
 
-	Node(int xpos, int ypos, int Cost)  {
-		x = xpos;
-		y = ypos;
-		cost = Cost;
-	}
-};
+// Last Map::version handed out, shared by every map so that no two boards (or two states of one) ever have the same one
+static atomic<uint64_t> lastMapVersion(0);
+
+// Class containing map manipulation functions and map characteristic variables
+class Map  {
+
+private:
+	int start[2]; // Start point on map
+	int end[2]; // End point on map
+
+	// Portals given in the map file, as (entry, exit) location indices. Only those whose entry is a 'T' and
+	// whose exit can be stood on are in use
+	vector<pair<int,int> > declaredPortals;
+
+public:
+
+	int width; // Width of map
+	int height; // Height of map
+	vector<char> map; // Local copy of chosen map, row-major (index y*width + x)
+
+	// Cost Map: Map of the cost to move to each location on the map, row-major like map
+	// The per-query search data (open, closed, parents) lives in SearchState so that
+	// one Map can be shared read-only between any number of searches
+	vector<uint8_t> costMap;
+
+	// Move Map: Bit i is set if the knight move dirmap[i] out of the location is legal, row-major like map
+	vector<unsigned char> moveMap;
+
+	// Reverse Move Map: Bit i is set if the knight move dirmap[i] into the location (from k - moveOffset[i]) is legal
+	// The same moves as moveMap seen from the landing end, for searching backward from the end point
+	vector<unsigned char> reverseMap;
+
+	// Index offset of each of the dirmap moves, moving from location index k to k + moveOffset[i]
+	int moveOffset[8];
+
+	// Portals in use, indexed by portal id, at most MAX_PORTALS of them (any more teleports are plain ground)
+	// Portal Map: Id of the portal whose entry each location is, -1 if none, row-major like map
+	// Arrival Map: Id of the first portal whose exit each location is (see Portal::nextArrival), -1 if none
+	vector<Portal> portals;
+	vector<int16_t> portalMap;
+	vector<int16_t> arrivalMap;
+	int portalVersion; // Changes whenever the portals in use do
+	// Unique to this map as it is now, across every map in the process: a new one is taken on construction and whenever
+	// anything about the map changes, in build() (so load()), loadBinary() and setChar()
+	uint64_t version;
 
-// Used in the Priority Queue to decide priority: Least cost is priority
-struct prioritizeShortest {
+	static const int MAX_PORTALS = 32767; // Most portal ids a portal map entry holds
 
-	bool operator()(const Node & a, const Node & b) const 
-	{
-		return a.cost > b.cost;
+	// Uniform Tile Map: 1 for each UNIFORM_TILE x UNIFORM_TILE tile of the map (tilesWide across, row-major) that is all
+	// plain ground a knight lands on for 1 ('.', 'S' or 'E'), where search() can jump across (see SearchState::jumps)
+	vector<uint8_t> uniformTiles;
+	int tilesWide;
+	static const int UNIFORM_TILE = 32;
+
+	int minCost; // Cheapest cost of moving to any location that can be landed on, scales the heuristic
+	int maxCost; // Dearest cost of moving to any location that can be landed on, sizes the open list
+
+	// A version no map has had before. A copy of a map keeps its version until either changes, which is safe as they agree
+	static uint64_t newVersion() {
+		return lastMapVersion.fetch_add(1, memory_order_relaxed) + 1;
 	}
-};
 
-// Used in the Priority Queue to decide priority: Most cost is priority
-struct prioritizeLongest {
+	// Initialize an empty map, use load() to read one in
+	Map() {
+		
+		width = 0;
+		height = 0;
+		minCost = 1;
+		maxCost = 1;
+
+		// Initialize start and end as absurd to know if none are found
+		start[0] = -1;
+		start[1] = -1;
+		end[0] = -1;
+		end[1] = -1;
 
-	bool operator()(const Node & a, const Node & b) const
-	{
-		return a.cost < b.cost;
+		portalVersion = 0;
+		version = newVersion();
+		tilesWide = 0;
 	}
 
-};
+	// Read a map from a stream: one row per line, every row the same width, then any portal lines
+	// Returns false (and leaves the map empty) if the input is not a valid map
+	bool load(istream &in) {
+
+		string line;
+		vector<string> portalLines;
+
+		width = 0;
+		height = 0;
+		map.clear();
+		declaredPortals.clear();
 
-// Checking if blocked by checking each tile between initial position
-// and end of movement position and seeing if a 'B' tile resides there
-// if so: YOU ARE BLOCKED!
+		// Rows are appended straight onto the flat map, no intermediate copy
+		while (getline(in, line)) {
 
-// Check if blocked for 2 movement in X
-bool blockCheckX(int i, Map map, Node current) {
-	for (int j = 1; j <= abs(dirmap[i][0]); j++) {
-		for (int k = 0; k <= abs(dirmap[i][1]); k++) {
-			if (map.getChar(current.x+(j*(dirmap[i][0]/abs(dirmap[i][0]))),
-				current.y+(k*(dirmap[i][1]/abs(dirmap[i][1])))) == 'B') {
-				return true;	
+			// Tolerate DOS line endings and blank lines
+			if (!line.empty() && line[line.size()-1] == '\r') {
+				line.erase(line.size()-1);
 			}
+			if (line.empty()) {
+				continue;
+			}
+			if (line.compare(0, 6, "portal") == 0) {
+				portalLines.push_back(line);
+				continue;
+			}
+
+			if (height == 0) {
+				width = line.size();
+			}
+			else if ((int)line.size() != width) {
+				cerr << "Map row " << height << " has width " << line.size() << ", expected " << width << "\n";
+				width = 0;
+				height = 0;
+				map.clear();
+				return false;
+			}
+			map.insert(map.end(), line.begin(), line.end());
+			height++;
 		}
-	}
-	return false; 
-}
 
-// Check if blocked for 2 movement in Y
-bool blockCheckY(int i, Map map, Node current) {
-	for (int k = 1; k <= abs(dirmap[i][1]); k++) {
-		for (int j = 0; j <= abs(dirmap[i][0]); j++) {
-			if (map.getChar(current.x+(j*(dirmap[i][0]/abs(dirmap[i][0]))),
-				current.y+(k*(dirmap[i][1]/abs(dirmap[i][1])))) == 'B') {
-				return true;	
+		if (height == 0) {
+			cerr << "Map is empty\n";
+			return false;
+		}
+		if ((long long)width*height > (long long)PARENT_INDEX + 1) {
+			cerr << "Map has " << (long long)width*height << " locations, at most " << PARENT_INDEX + 1 << " are supported\n";
+			width = 0;
+			height = 0;
+			map.clear();
+			return false;
+		}
+
+		for (size_t p = 0; p < portalLines.size(); p++) {
+			istringstream fields(portalLines[p].substr(6));
+			int x1, y1, x2, y2;
+			string oneway;
+			if (!(fields >> x1 >> y1 >> x2 >> y2) || (fields >> oneway && oneway != "oneway") ||
+				x1 < 0 || x1 >= width || y1 < 0 || y1 >= height || x2 < 0 || x2 >= width || y2 < 0 || y2 >= height ||
+				(x1 == x2 && y1 == y2) || map[y1*width + x1] != 'T' || (oneway.empty() && map[y2*width + x2] != 'T')) {
+				cerr << "Bad portal line: " << portalLines[p] << "\n";
+				width = 0;
+				height = 0;
+				map.clear();
+				declaredPortals.clear();
+				return false;
+			}
+			declaredPortals.push_back(make_pair(y1*width + x1, y2*width + x2));
+			if (oneway.empty()) {
+				declaredPortals.push_back(make_pair(y2*width + x2, y1*width + x1));
 			}
 		}
-	}
-	return false;
-}
 
-// A* search algorithm to find end point
-// Inside, to change search from shortest to longest, one must change
-// prioritizeShortest to prioritizeLongest in the priority queue definition
-Map search(Map map) {
+		build();
+		return true;
+	}
 
-	// 									Priority queue sorting lowest cost options
-	// **************************************************************************************************************************
-	// ****************** Change prioritizeShortest to prioritizeLongest to get the Longest Path to the End Point ***********************
-	// **************************************************************************************************************************
-	priority_queue<Node, vector<Node>, prioritizeShortest> openpq;
+	// Work out everything else about the map from its terrain: costs, start and end, portals and move tables
+	void build() {
 
-	// Helper variables for calculations in search
-	int currdirx;
-	int currdiry;
-	int elecost;
+		version = newVersion();
 
-	bool blocked = false;  // Blocked path helper variable
+		// Run through map and update all costMap information
+		costMap.resize(width*height);
+		start[0] = -1;
+		start[1] = -1;
+		end[0] = -1;
+		end[1] = -1;
 
-	// Set the parent of the starting point to itself
-	map.setParent(map.getStartX(), map.getStartY(), map.getStartX(), map.getStartY());
+		for (int j = 0; j < height; j++) {
+			for (int i = 0; i < width; i++) {
 
-	// Update current with starting point
-	Node current(map.getStartX(), map.getStartY(), 0);
-	openpq.push(current);
+				char c = getChar(i, j);
+				setCost(i, j, terrainCost(c));
 
-	// Loop through sorted search elements until we arrive at the end
-	while (!openpq.empty()) {
+				// Set start point (the start is never moved to, so it keeps the plain cost of 1
+				// and a route can never pick up a free move by landing back on it)
+				if (c == 'S') {
+					start[0] = i;
+					start[1] = j;
+				}
 
-		// Update then pop our current position off the open pqueue
-		current = openpq.top();
-		openpq.pop();
+				// Set end point (remain cost of 1 to move there)
+				if (c == 'E') {
+					end[0] = i;
+					end[1] = j;
+				}
+			}
+		}
 
-		// Add this point to the closed map to indicate that its neighbors have been searched
-		map.addToClosed(current.x, current.y);
+		findPortals();
 
-		// Stop if we are at the goal, set the final resting position, and return the updated map class
-		if (current.x == map.getEndX() && current.y == map.getEndY()) {
-			map.setFinal(current.x, current.y, current.cost);
-			return map;
+		// Find the cheapest and dearest locations a knight can land on
+		minCost = -1;
+		maxCost = 1;
+		for (int k = 0; k < width*height; k++) {
+			if (map[k] != 'B' && map[k] != 'R') {
+				if (minCost < 0 || costMap[k] < minCost) {
+					minCost = costMap[k];
+				}
+				maxCost = max(maxCost, (int)costMap[k]);
+			}
+		}
+		if (minCost < 0) {
+			minCost = 1;
 		}
 
-		// Run through the possible next positions
+		// Build the table of legal moves out of every location
 		for (int i = 0; i < 8; i++) {
-			
-			blocked = false;  // Reset blocked bool
+			moveOffset[i] = dirmap[i][1]*width + dirmap[i][0];
+		}
+		moveMap.resize(width*height);
+		for (int j = 0; j < height; j++) {
+			for (int i = 0; i < width; i++) {
+				updateMoves(i, j);
+			}
+		}
+		reverseMap.resize(width*height);
+		for (int j = 0; j < height; j++) {
+			for (int i = 0; i < width; i++) {
+				updateReverseMoves(i, j);
+			}
+		}
 
-			// Define utility variables to store position plus direction movements and update cost function
-			currdirx = current.x + dirmap[i][0];
-			currdiry = current.y + dirmap[i][1];
+		findUniformTiles();
+	}
 
-			// When checking whether a path/route is blocked:
-			// ASSUMPTION: MOVE IN 2 MOVEMENT DIRECTION FIRST
-			// Do not add to queue a block pass through
-			if (!(currdirx > (map.size-1) || currdirx < 0 || currdiry > (map.size-1) || currdiry < 0)) {
+	// Write the map in the binary board format (see BoardHeader)
+	bool saveBinary(ostream &out) const {
 
-				// Update cost calculation helper variable
-				elecost = current.cost + map.getCost(currdirx, currdiry);
+		uint32_t one = 1;
+		if (*(const unsigned char *)&one != 1) {
+			cerr << "The binary board format can only be written on a little-endian machine\n";
+			return false;
+		}
 
-				// Check blocked if movement is 2 or -2 in X direction
-				if ((i == 0) || (i == 3) || (i == 4) || (i == 7)) {
-					blocked = blockCheckX(i, map, current);				
-				}
-	
-				// Check blocked if movement is 2 or -2 in Y direction
-				else {
-					blocked = blockCheckY(i, map, current);
-				}
-
-				// Conditions for teleport locations.
-				// Add both to searched map (open map), set the parent of the landed on teleport
-				// As the current location, set the landed on teleport as the parent of the teleported to point
-				// No extra cost added for the teleport
-				if (!(map.getChar(currdirx, currdiry) != 'T' || map.getClosed(currdirx, currdiry) == 1 ||  map.getOpen(currdirx, currdiry) == 1))
-				{
-					if (!((currdirx != map.getT1X()) || (currdiry != map.getT1Y()))) 
-					{
-						openpq.push(Node(map.getT2X(), map.getT2Y(), (current.cost + map.getCost(currdirx, currdiry))));
-						map.addToOpen(currdirx, currdiry);
-						map.setParent(map.getT2X(), map.getT2Y(), map.getT1X(), map.getT1Y());
-						map.setParent(map.getT1X(), map.getT1Y(), current.x, current.y);
-					}
-					else 
-					{
-						openpq.push(Node(map.getT1X(), map.getT1Y(), (current.cost + map.getCost(currdirx, currdiry))));
-						map.addToOpen(currdirx, currdiry);
-						map.setParent(map.getT1X(), map.getT1Y(), map.getT2X(), map.getT2Y());
-						map.setParent(map.getT2X(), map.getT2Y(), current.x, current.y);
-					}
-				}
-	
-				// If the way does not encounter a block, nor does it land on a rock,
-				// Nor has it been landed on or added already
-				// Procede with adding the movement to next vector
-				else if (!(blocked || (map.getChar(currdirx, currdiry) == 'R') || 
-						(map.getClosed(currdirx, currdiry) == 1) || (map.getOpen(currdirx, currdiry) == 1))) 
-				{
-					openpq.push(Node(currdirx, currdiry, (current.cost + map.getCost(currdirx, currdiry))));
-					map.addToOpen(currdirx, currdiry);
-					map.setParent(currdirx, currdiry, current.x, current.y);
-				}
-			}
+		BoardHeader header;
+		memcpy(header.magic, "KBMP", 4);
+		header.version = BOARD_VERSION;
+		header.width = width;
+		header.height = height;
+		header.portals = portals.size();
+		header.declared = declaredPortals.size();
+		header.start = start[0] < 0 ? -1 : start[1]*width + start[0];
+		header.end = end[0] < 0 ? -1 : end[1]*width + end[0];
+		header.minCost = minCost;
+		header.maxCost = maxCost;
+		out.write((const char *)&header, sizeof(header));
+
+		out.write(&map[0], map.size());
+		out.write((const char *)&costMap[0], costMap.size());
+		out.write((const char *)&moveMap[0], moveMap.size());
+		out.write((const char *)&reverseMap[0], reverseMap.size());
+		for (size_t p = 0; p < portals.size(); p++) {
+			uint32_t pair[2] = {(uint32_t)portals[p].entry, (uint32_t)portals[p].exit};
+			out.write((const char *)pair, sizeof(pair));
+		}
+		for (size_t p = 0; p < declaredPortals.size(); p++) {
+			uint32_t pair[2] = {(uint32_t)declaredPortals[p].first, (uint32_t)declaredPortals[p].second};
+			out.write((const char *)pair, sizeof(pair));
 		}
+		return out.good();
 	}
-	// If there is no route, return the start points, and 0 cost for our final rest point
-	map.setFinal(map.getStartX(), map.getStartY(), 0);
-	return map;
-}
 
-// Reconstructs the path back from the end point to the start
-// Via the route recorded in mapData
-vector<Node> reconstructPath(Map map) {
-	
-	vector<Node> total_path;  // Vector of the path back to the start
+	// Read a map in the binary board format from the file at path
+	// The file is memory-mapped and every table is checked where it lies before any of it is copied,
+	// so a bad or truncated file is turned away without reading past its end or building anything.
+	// This is not zero-copy: the tables are copied into the Map's own vectors and the file is unmapped before returning.
+	// Returns false (and leaves the map empty) if the file is not a valid board
+	bool loadBinary(const char *path) {
 
-	// Set our rerouting loop vars as the final location of x and y
-	// And set local var to the final cost of route
-	int i = map.getFinalX();
-	int j = map.getFinalY();
-	int cost = map.getFinalCost();
+		width = 0;
+		height = 0;
+		map.clear();
+		declaredPortals.clear();
 
-	total_path.push_back(Node(i,j));
+		int fd = open(path, O_RDONLY);
+		if (fd < 0) {
+			cerr << "Could not open map file " << path << "\n";
+			return false;
+		}
+		struct stat info;
+		if (fstat(fd, &info) != 0 || info.st_size < (off_t)sizeof(BoardHeader)) {
+			cerr << "Map file " << path << " is too short for a board\n";
+			close(fd);
+			return false;
+		}
+		size_t size = info.st_size;
+		void *mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (mapped == MAP_FAILED) {
+			cerr << "Could not map file " << path << "\n";
+			return false;
+		}
 
-	int tempi;
-	int tempj;
+		const char *problem = checkBinary((const unsigned char *)mapped, size);
+		if (problem != NULL) {
+			cerr << "Map file " << path << " is not a valid board: " << problem << "\n";
+			munmap(mapped, size);
+			return false;
+		}
 
-	// Follow the map of parent nodes back to the map start point
-	// And push each successive Node into the total_path
-	while ((i != map.getStartX()) || (j != map.getStartY())) {
+		const BoardHeader *header = (const BoardHeader *)mapped;
+		int cells = header->width*header->height;
+		const char *terrain = (const char *)mapped + sizeof(BoardHeader);
+		const uint32_t *pairs = (const uint32_t *)(terrain + 4*(size_t)cells);
 
-		tempi = map.getParentX(i, j);
-		tempj = map.getParentY(i, j);
+		width = header->width;
+		height = header->height;
+		start[0] = header->start < 0 ? -1 : header->start % width;
+		start[1] = header->start < 0 ? -1 : header->start / width;
+		end[0] = header->end < 0 ? -1 : header->end % width;
+		end[1] = header->end < 0 ? -1 : header->end / width;
+		minCost = header->minCost;
+		maxCost = header->maxCost;
+		for (int i = 0; i < 8; i++) {
+			moveOffset[i] = dirmap[i][1]*width + dirmap[i][0];
+		}
 
-		i =  tempi;
-		j = tempj;
+		map.assign(terrain, terrain + cells);
+		costMap.assign(terrain + cells, terrain + 2*cells);
+		moveMap.assign(terrain + 2*cells, terrain + 3*cells);
+		reverseMap.assign(terrain + 3*cells, terrain + 4*cells);
 
-		total_path.push_back(Node(i,j));
-	}
+		portals.clear();
+		portalMap.assign(cells, -1);
+		arrivalMap.assign(cells, -1);
+		portalVersion++;
+		version = newVersion();
+		for (uint32_t p = 0; p < header->portals; p++) {
+			addPortal(pairs[2*p], pairs[2*p + 1]);
+		}
+		pairs += 2*header->portals;
+		for (uint32_t p = 0; p < header->declared; p++) {
+			declaredPortals.push_back(make_pair((int)pairs[2*p], (int)pairs[2*p + 1]));
+		}
 
-	cout << "Original Map:\n";
-	map.printMap();
-	cout << "\n";
+		munmap(mapped, size);
+		findUniformTiles();
+		return true;
+	}
 
-	// Mark 'K' on map where we have moved to
-	for (int i = 0; i < total_path.size()-1; i++) {
-		map.setChar(total_path[i].x, total_path[i].y, 'K');
+	// Difference between the reverse table entry of (i, j) and the moves into it on a binary board's tables,
+	// or -1 if a move out of it leaves the board
+	static int edgeDifference(const uint8_t *moves, const uint8_t *reverse, int w, int h, int i, int j, const int *offset) {
+		int k = j*w + i;
+		uint8_t expected = 0;
+		for (int d = 0; d < 8; d++) {
+			int x = i + dirmap[d][0];
+			int y = j + dirmap[d][1];
+			if (((moves[k] >> d) & 1) && (x < 0 || x >= w || y < 0 || y >= h)) {
+				return -1;
+			}
+			x = i - dirmap[d][0];
+			y = j - dirmap[d][1];
+			if (x >= 0 && x < w && y >= 0 && y < h) {
+				expected |= moves[k - offset[d]] & (1 << d);
+			}
+		}
+		return expected ^ reverse[k];
 	}
 
-	cout << "Map of Moves:\n";
-	map.printMap();
+	// Check a binary board of size bytes where it lies, returns what is wrong with it or NULL if nothing is
+	// Anything the searches index with is checked: every move in the tables stays on the board and agrees
+	// with the other table, and every portal joins two locations on the board
+	static const char *checkBinary(const unsigned char *data, size_t size) {
 
-	cout << "Cost of Movement: " << cost << "\n";
+		uint32_t one = 1;
+		if (*(const unsigned char *)&one != 1) {
+			return "the binary board format can only be read on a little-endian machine";
+		}
 
-	return total_path;
-}
+		const BoardHeader *header = (const BoardHeader *)data;
+		if (memcmp(header->magic, "KBMP", 4) != 0) {
+			return "no KBMP header";
+		}
+		if (header->version != BOARD_VERSION) {
+			return "unknown version";
+		}
+		uint64_t cells = (uint64_t)header->width*header->height;
+		if (header->width == 0 || header->height == 0 || cells > (uint64_t)PARENT_INDEX + 1) {
+			return "bad size";
+		}
+		if (header->portals > (uint32_t)MAX_PORTALS ||
+			size != sizeof(BoardHeader) + 4*cells + 8*((uint64_t)header->portals + header->declared)) {
+			return "file length does not match the header";
+		}
+		if ((header->start < -1 || header->start >= (int64_t)cells) || (header->end < -1 || header->end >= (int64_t)cells) ||
+			header->minCost < 1 || header->minCost > header->maxCost || header->maxCost > 255) {
+			return "bad header field";
+		}
 
-// Function that verifies a sequence of moves
-bool verifySequence(vector<Node> total_path, Map map) {
+		int w = header->width;
+		int h = header->height;
+		const char *terrain = (const char *)data + sizeof(BoardHeader);
+		const uint8_t *costs = (const uint8_t *)terrain + cells;
+		const uint8_t *moves = costs + cells;
+		const uint8_t *reverse = moves + cells;
+		const uint32_t *pairs = (const uint32_t *)(reverse + cells);
 
-	for (int i = 0; i < total_path.size()-1; i++) {
-		if (!((abs(total_path[i].x - total_path[i+1].x) == 1 &&
-			   abs(total_path[i].y - total_path[i+1].y) == 2) ||
-			  (abs(total_path[i].x - total_path[i+1].x) == 2 &&
-			   abs(total_path[i].y - total_path[i+1].y) == 1)))
-		{
-			if (!((total_path[i+1].x == map.getT1X() && total_path[i+1].y == map.getT1Y()) ||
-				  (total_path[i+1].x == map.getT2X() && total_path[i+1].y == map.getT2Y())))
-			{
-				cout << "The sequence failed to pass inspection.\n";
-				return false;
+		int offset[8];
+		for (int d = 0; d < 8; d++) {
+			offset[d] = dirmap[d][1]*w + dirmap[d][0];
+		}
+		uint8_t terrainCosts[256];
+		for (int c = 0; c < 256; c++) {
+			terrainCosts[c] = terrainCost((char)c);
+		}
+
+		uint8_t costDiffers = 0;
+		for (uint64_t k = 0; k < cells; k++) {
+			costDiffers |= costs[k] ^ terrainCosts[(unsigned char)terrain[k]];
+		}
+
+		// The reverse table has to be exactly the moves of the move table seen from where they land, and no move
+		// can leave the board. Only locations within two of the edge have moves that could, so the rest are
+		// checked without a branch, folding any difference into one flag
+		int reverseDiffers = 0;
+		for (int j = 0; j < h; j++) {
+			bool middle = (j >= 2 && j < h-2);
+			for (int i = 0; i < w; i++) {
+				if (middle && i == 2 && w > 4) {
+					for (int k = j*w + 2; k < j*w + w-2; k++) {
+						uint8_t expected = 0;
+						for (int d = 0; d < 8; d++) {
+							expected |= moves[k - offset[d]] & (1 << d);
+						}
+						reverseDiffers |= expected ^ reverse[k];
+					}
+					i = max(i, w-3);
+					continue;
+				}
+				int difference = edgeDifference(moves, reverse, w, h, i, j, offset);
+				if (difference < 0) {
+					return "move off the board";
+				}
+				reverseDiffers |= difference;
+			}
+		}
+		if (costDiffers) {
+			return "cost does not match terrain";
+		}
+		if (reverseDiffers) {
+			return "move tables disagree";
+		}
+
+		// Portals in use need distinct 'T' entries and exits a knight can stand on, portal lines just need to be on the board
+		vector<char> entries(cells, 0);
+		for (uint32_t p = 0; p < header->portals + header->declared; p++) {
+			uint32_t entry = pairs[2*p];
+			uint32_t exit = pairs[2*p + 1];
+			if (entry >= cells || exit >= cells || entry == exit) {
+				return "portal off the board";
+			}
+			if (p < header->portals) {
+				if (terrain[entry] != 'T' || terrain[exit] == 'B' || terrain[exit] == 'R' || entries[entry]) {
+					return "bad portal";
+				}
+				entries[entry] = 1;
 			}
 		}
+		if ((header->start >= 0 && terrain[header->start] != 'S') || (header->end >= 0 && terrain[header->end] != 'E')) {
+			return "start or end does not match terrain";
+		}
+		return NULL;
 	}
-	cout << "The sequence successfully passed inspection.\n";
-	return true;
-}
 
-int main() {
+	// Cost of moving to a location with the given terrain
+	static int terrainCost(char c) {
 
-	// Map being loaded in
-	Map map(n,bmap);
+		// Water movement cost 2
+		if (c == 'W') {
+			return 2;
+		}
 
-	// Create a bad sequence of moves to test verifySequence on
-	vector<Node> test = {Node(1,1), Node(3,2), Node(4,4), Node(5,6), Node(7,8), Node(9,9), Node(10,11)};
-	
-	// Search, generate routes, plots maps, and verify for select map
-	verifySequence(reconstructPath(search(map)), map);
-	
-	// Verify our test sequence (should return bad)
-	verifySequence(test, map);
+		// Lava movement cost 5
+		if (c == 'L') {
+			return 5;
+		}
 
-	return(0);
-} 
+		return 1;
+	}
+
+	// Work out the portals in use: each declared portal whose entry is a 'T' and whose exit can be stood on,
+	// then the 'T's none of them name paired up two by two in row order (an odd one out is plain ground)
+	void findPortals() {
+
+		portals.clear();
+		portalMap.assign(width*height, -1);
+		arrivalMap.assign(width*height, -1);
+		portalVersion++;
+
+		// Mark every location a portal line names, whether or not it is in use
+		for (size_t p = 0; p < declaredPortals.size(); p++) {
+			portalMap[declaredPortals[p].first] = -2;
+			portalMap[declaredPortals[p].second] = -2;
+		}
+
+		int paired = -1;
+		for (int k = 0; k < width*height; k++) {
+			if (map[k] == 'T' && portalMap[k] == -1) {
+				if (paired < 0) {
+					paired = k;
+				}
+				else if ((int)portals.size() + 2 <= MAX_PORTALS) {
+					addPortal(paired, k);
+					addPortal(k, paired);
+					paired = -1;
+				}
+			}
+		}
+		for (size_t p = 0; p < declaredPortals.size(); p++) {
+			int entry = declaredPortals[p].first;
+			int exit = declaredPortals[p].second;
+			if (map[entry] == 'T' && map[exit] != 'B' && map[exit] != 'R' && portalMap[entry] < 0 &&
+				(int)portals.size() < MAX_PORTALS) {
+				addPortal(entry, exit);
+			}
+		}
+
+		for (size_t p = 0; p < declaredPortals.size(); p++) {
+			if (portalMap[declaredPortals[p].first] == -2) {
+				portalMap[declaredPortals[p].first] = -1;
+			}
+			if (portalMap[declaredPortals[p].second] == -2) {
+				portalMap[declaredPortals[p].second] = -1;
+			}
+		}
+	}
+
+	void addPortal(int entry, int exit) {
+		Portal portal;
+		portal.entry = entry;
+		portal.exit = exit;
+		portal.nextArrival = arrivalMap[exit];
+		portalMap[entry] = portals.size();
+		arrivalMap[exit] = portals.size();
+		portals.push_back(portal);
+	}
+
+	// Checking if blocked by checking each tile between initial position
+	// and end of movement position and seeing if a 'B' tile resides there
+	// if so: YOU ARE BLOCKED!
+	// ASSUMPTION: MOVE IN 2 MOVEMENT DIRECTION FIRST
+	bool moveBlocked(int x, int y, int i) const {
+
+		int sx = dirmap[i][0] > 0 ? 1 : -1;
+		int sy = dirmap[i][1] > 0 ? 1 : -1;
+
+		// Check blocked for 2 movement in X
+		if (abs(dirmap[i][0]) == 2) {
+			for (int j = 1; j <= 2; j++) {
+				for (int k = 0; k <= 1; k++) {
+					if (getChar(x + j*sx, y + k*sy) == 'B') {
+						return true;
+					}
+				}
+			}
+		}
+
+		// Check blocked for 2 movement in Y
+		else {
+			for (int k = 1; k <= 2; k++) {
+				for (int j = 0; j <= 1; j++) {
+					if (getChar(x + j*sx, y + k*sy) == 'B') {
+						return true;
+					}
+				}
+			}
+		}
+		return false;
+	}
+
+	// Work out which of the 8 knight moves out of (x, y) are legal: on the map,
+	// not passing through a block and not landing on a rock
+	void updateMoves(int x, int y) {
+
+		unsigned char moves = 0;
+
+		for (int i = 0; i < 8; i++) {
+			int currdirx = x + dirmap[i][0];
+			int currdiry = y + dirmap[i][1];
+
+			if (currdirx > (width-1) || currdirx < 0 || currdiry > (height-1) || currdiry < 0) {
+				continue;
+			}
+			if (moveBlocked(x, y, i) || getChar(currdirx, currdiry) == 'R') {
+				continue;
+			}
+			moves |= 1 << i;
+		}
+		moveMap[y*width + x] = moves;
+	}
+
+	// Work out which of the 8 knight moves into (x, y) are legal, from the move table of each location
+	// a knight move away
+	void updateReverseMoves(int x, int y) {
+
+		unsigned char moves = 0;
+
+		for (int i = 0; i < 8; i++) {
+			int fromx = x - dirmap[i][0];
+			int fromy = y - dirmap[i][1];
+
+			if (fromx > (width-1) || fromx < 0 || fromy > (height-1) || fromy < 0) {
+				continue;
+			}
+			if (getMoves(fromx, fromy) & (1 << i)) {
+				moves |= 1 << i;
+			}
+		}
+		reverseMap[y*width + x] = moves;
+	}
+
+	// Various map get functions
+	int getStartX() const {return start[0];}
+	int getStartY() const {return start[1];}
+	int getEndX() const {return end[0];}
+	int getEndY() const {return end[1];}
+	bool hasPortals() const {return !portals.empty();}
+
+	// Id of the portal landing on location k goes through, -1 if k is not a portal entry
+	int getPortal(int k) const {return portalMap[k];}
+
+	// Index of the location that landing on location k ends up on through its portal, -1 if k is not a portal entry
+	int getPortalExit(int k) const {
+		int id = portalMap[k];
+		return id < 0 ? -1 : portals[id].exit;
+	}
+
+	// Id of the first portal that ends up on location k, -1 if none; follow Portal::nextArrival for the rest
+	int getFirstArrival(int k) const {return arrivalMap[k];}
+
+	// The locations a knight can land on to end up standing on location k, one per call: k itself unless
+	// it is a portal entry, then the entry of each portal leading to k. Pass -1 for the first and the one
+	// returned last for the next. Returns -1 when there are no more
+	int nextLanding(int k, int landing) const {
+		int id;
+		if (landing < 0 && portalMap[k] < 0) {
+			return k;
+		}
+		else if (landing < 0 || landing == k) {
+			id = arrivalMap[k];
+		}
+		else {
+			id = portals[portalMap[landing]].nextArrival;
+		}
+		return id < 0 ? -1 : portals[id].entry;
+	}
+
+	char getChar(int x, int y) const {return map[y*width + x];}
+	int getCost(int x, int y) const {return costMap[y*width + x];}
+	unsigned int getMoves(int x, int y) const {return moveMap[y*width + x];}
+	unsigned int getReverseMoves(int x, int y) const {return reverseMap[y*width + x];}
+
+	// The same, by location index (y*width + x)
+	char getChar(int k) const {return map[k];}
+	int getCost(int k) const {return costMap[k];}
+	unsigned int getMoves(int k) const {return moveMap[k];}
+	unsigned int getReverseMoves(int k) const {return reverseMap[k];}
+
+	// Set functions for various map data elements
+
+	// Change the terrain of one location, keeping costs, portals and the move table up to date.
+	// Only moves out of the 5x5 square around (x, y) can pass through or land on it, so only those
+	// are redone, and the moves into the 9x9 square their landing points lie in.
+	// minCost and maxCost are only ever widened here, which keeps them safe bounds
+	void setChar(int x, int y, char Char) {
+
+		char old = getChar(x, y);
+		map[y*width + x] = Char;
+		setCost(x, y, terrainCost(Char));
+		version = newVersion();
+
+		if (Char != 'B' && Char != 'R') {
+			minCost = min(minCost, getCost(x, y));
+			maxCost = max(maxCost, getCost(x, y));
+		}
+
+		// A location a portal line names can start or stop a portal being in use
+		bool declared = false;
+		for (size_t p = 0; p < declaredPortals.size() && !declared; p++) {
+			declared = (declaredPortals[p].first == y*width + x || declaredPortals[p].second == y*width + x);
+		}
+		if (old == 'T' || Char == 'T' || declared) {
+			findPortals();
+		}
+		if (Char == 'S') {
+			start[0] = x;
+			start[1] = y;
+		}
+		if (Char == 'E') {
+			end[0] = x;
+			end[1] = y;
+		}
+
+		for (int j = max(y-2, 0); j <= min(y+2, height-1); j++) {
+			for (int i = max(x-2, 0); i <= min(x+2, width-1); i++) {
+				updateMoves(i, j);
+			}
+		}
+		for (int j = max(y-4, 0); j <= min(y+4, height-1); j++) {
+			for (int i = max(x-4, 0); i <= min(x+4, width-1); i++) {
+				updateReverseMoves(i, j);
+			}
+		}
+		updateUniformTile(x / UNIFORM_TILE, y / UNIFORM_TILE);
+	}
+
+	// Mark every tile of the uniform tile map
+	void findUniformTiles() {
+		tilesWide = (width + UNIFORM_TILE - 1) / UNIFORM_TILE;
+		int tilesHigh = (height + UNIFORM_TILE - 1) / UNIFORM_TILE;
+		uniformTiles.assign(tilesWide*tilesHigh, 0);
+		for (int ty = 0; ty < tilesHigh; ty++) {
+			for (int tx = 0; tx < tilesWide; tx++) {
+				updateUniformTile(tx, ty);
+			}
+		}
+	}
+
+	// Work out whether tile (tx, ty) is uniform
+	void updateUniformTile(int tx, int ty) {
+		bool uniform = true;
+		for (int j = ty*UNIFORM_TILE; j < min((ty + 1)*UNIFORM_TILE, height) && uniform; j++) {
+			for (int i = tx*UNIFORM_TILE; i < min((tx + 1)*UNIFORM_TILE, width); i++) {
+				char c = map[j*width + i];
+				uniform &= (c == '.' || c == 'S' || c == 'E') && costMap[j*width + i] == 1;
+			}
+		}
+		uniformTiles[ty*tilesWide + tx] = uniform;
+	}
+
+	// If (x, y) is deep enough inside a uniform region for search() to jump from, fill inner with the part of the
+	// region two locations in from its edges (x0, y0, x1, y1 inclusive) and return true. The region is the block of
+	// tiles around the one (x, y) is on if they are all uniform, otherwise that tile alone if it is.
+	// Any two locations of inner are exactly knightDistance() apart, by a route that never leaves the region, and
+	// a route out of inner has to land on its outer two rows or columns first. (x, y) has to be two further in than that
+	bool uniformInterior(int x, int y, int inner[4]) const {
+		int tx = x / UNIFORM_TILE;
+		int ty = y / UNIFORM_TILE;
+		if (!uniformTiles[ty*tilesWide + tx]) {
+			return false;
+		}
+
+		int tilesHigh = uniformTiles.size() / tilesWide;
+		int x0 = max(tx - 1, 0);
+		int y0 = max(ty - 1, 0);
+		int x1 = min(tx + 1, tilesWide - 1);
+		int y1 = min(ty + 1, tilesHigh - 1);
+		bool block = true;
+		for (int j = y0; j <= y1; j++) {
+			for (int i = x0; i <= x1; i++) {
+				block &= (uniformTiles[j*tilesWide + i] != 0);
+			}
+		}
+		if (!block) {
+			x0 = x1 = tx;
+			y0 = y1 = ty;
+		}
+
+		inner[0] = x0*UNIFORM_TILE + 2;
+		inner[1] = y0*UNIFORM_TILE + 2;
+		inner[2] = min((x1 + 1)*UNIFORM_TILE, width) - 3;
+		inner[3] = min((y1 + 1)*UNIFORM_TILE, height) - 3;
+		return x >= inner[0] + 2 && x <= inner[2] - 2 && y >= inner[1] + 2 && y <= inner[3] - 2;
+	}
+
+	void setCost(int x, int y, int Cost) {
+		costMap[y*width + x] = Cost;
+	}
+
+	// Prints information about the map
+	void printMapStats() const {
+		cout << "Start Point (X, Y): (" << getStartX() << ", " << getStartY() << ")\n";
+		cout << "End Point (X, Y): (" << getEndX() << ", " << getEndY() << ")\n";
+		for (size_t p = 0; p < portals.size(); p++) {
+			cout << "Portal " << p << " (X, Y): (" << portals[p].entry % width << ", " << portals[p].entry / width
+				 << ") to (" << portals[p].exit % width << ", " << portals[p].exit / width << ")\n";
+		}
+		cout << "Map Size (W, H): (" << width << ", " << height << ")\n";
+	}
+
+	// Append the entire map to out, one row per line, a row at a time
+	// Location (x, y) ends up at out[start + y*(width + 1) + x], where start is the size of out beforehand
+	void renderMap(string &out) const {
+		size_t start = out.size();
+		out.resize(start + height*(width + 1));
+		for (int j = 0; j < height; j++) {
+			char *row = &out[start + j*(width + 1)];
+			memcpy(row, &map[j*width], width);
+			row[width] = '\n';
+		}
+	}
+
+	// Print the entire map
+	void printMap() const {
+		string out;
+		renderMap(out);
+		cout.write(out.data(), out.size());
+	}
+
+	// Print the entire map with each of the marked locations drawn as 'K'
+	void printMap(const vector<Node> &marks) const {
+		string out;
+		renderMap(out);
+		for (size_t i = 0; i < marks.size(); i++) {
+			out[marks[i].y*(width + 1) + marks[i].x] = 'K';
+		}
+		cout.write(out.data(), out.size());
+	}
+
+	// Print the entire cost map
+	void printCostMap() const {
+		for (int j = 0; j < height; j++) {
+			for (int i = 0; i < width; i++) {
+				cout << getCost(i, j);
+			}
+			cout << '\n';
+		}
+	}
+};
+
+// Estimate of the number of moves from a location to an end point that never overestimates
+// Landing on a portal entry swaps the moves still to go from there for those from its exit, so each portal
+// offers a bound of the moves to its entry plus the fewest moves from its exit to the end, itself through any
+// further portals (a shortest path over the portals, worked out once per end point). The smallest bound is taken.
+// Each bound changes by at most one per knight move, which keeps the estimate consistent as well.
+// On boards with a great many portals only the fewest moves from any exit to the end is kept, which is weaker
+// but keeps each estimate O(1).
+// Moves are counted in the steps of a move set (see Leaper), knight moves for the Heuristic search() uses
+template <class Moves>
+class BasicHeuristic {
+
+private:
+
+	static const int EXACT_PORTALS = 64; // Most portals given a bound each
+
+	int endx; // End point estimated to
+	int endy;
+	int floor; // Fewest moves of any route through a portal, used with more than EXACT_PORTALS
+	int growth; // Most the estimate can go up in one move
+
+	// Per portal, when there are few enough: its entry and the fewest moves from its exit to the end
+	vector<int> entryX;
+	vector<int> entryY;
+	vector<int> rest;
+
+public:
+
+	BasicHeuristic() {
+		endx = 0;
+		endy = 0;
+		floor = 0;
+		growth = 1;
+	}
+
+	// Work out the bounds of map's portals for the end point (ex, ey)
+	// Only allocates if the map has more portals than any seen before
+	void reset(const Map &map, int ex, int ey) {
+
+		endx = ex;
+		endy = ey;
+		entryX.clear();
+		entryY.clear();
+		rest.clear();
+
+		int n = map.portals.size();
+		floor = 0x3fffffff;
+		if (n > EXACT_PORTALS) {
+			for (int p = 0; p < n; p++) {
+				int exit = map.portals[p].exit;
+				floor = min(floor, 1 + Moves::distance(ex - exit % map.width, ey - exit / map.width));
+			}
+		}
+		else {
+			for (int p = 0; p < n; p++) {
+				int exit = map.portals[p].exit;
+				entryX.push_back(map.portals[p].entry % map.width);
+				entryY.push_back(map.portals[p].entry / map.width);
+				rest.push_back(Moves::distance(ex - exit % map.width, ey - exit / map.width));
+			}
+
+			// Dijkstra over the portals: settle the portal with the fewest moves left, then see if
+			// landing on its entry is a shortcut from any other exit. rest[] goes negative once settled
+			for (int settled = 0; settled < n; settled++) {
+				int p = -1;
+				for (int q = 0; q < n; q++) {
+					if (rest[q] >= 0 && (p < 0 || rest[q] < rest[p])) {
+						p = q;
+					}
+				}
+				for (int q = 0; q < n; q++) {
+					int exit = map.portals[q].exit;
+					if (rest[q] >= 0) {
+						rest[q] = min(rest[q], Moves::distance(entryX[p] - exit % map.width, entryY[p] - exit / map.width) + rest[p]);
+					}
+				}
+				rest[p] = -1 - rest[p];
+			}
+			for (int p = 0; p < n; p++) {
+				rest[p] = -1 - rest[p];
+			}
+		}
+
+		// Going through a portal can take a knight to where the estimate is a lot higher than next to the entry,
+		// which is at most one off the estimate at the entry itself
+		growth = 1;
+		for (int p = 0; p < n; p++) {
+			int entry = map.portals[p].entry;
+			int exit = map.portals[p].exit;
+			growth = max(growth, moves(exit % map.width, exit / map.width) - moves(entry % map.width, entry / map.width) + 1);
+		}
+	}
+
+	// Estimated moves from (x, y) to the end point
+	int moves(int x, int y) const {
+		int m = min(Moves::distance(endx - x, endy - y), floor);
+		for (size_t p = 0; p < rest.size(); p++) {
+			m = min(m, Moves::distance(entryX[p] - x, entryY[p] - y) + rest[p]);
+		}
+		return m;
+	}
+
+	// Most the estimate of a location can be above the estimate of one a move before it
+	int getGrowth() const {return growth;}
+};
+
+typedef BasicHeuristic<Knight> Heuristic;
+
+// Open list for search(): an indexed priority queue over map locations (index y*width + x)
+// Priorities are small integers, so locations are kept in one doubly linked list per priority
+// (a bucket queue) and push, decrease-key and pop are all O(1).
+// Two rules keep it that small: priorities popped never go down, and no location is ever given a priority
+// more than the span passed to reset() above the lowest one in the queue. A* with a consistent
+// heuristic keeps both, with a span of the dearest move plus the most the heuristic can grow per move
+// (see Heuristic::getGrowth()). The span can be at most MAX_SPAN
+class BucketQueue {
+
+public:
+
+	static const int MAX_SPAN = 65535; // Widest span reset() takes, the most a bucket index holds
+
+private:
+	vector<int> head; // First location in each bucket, -1 if empty
+	vector<int> next; // Next location in the same bucket, per location
+	vector<int> prev; // Previous location in the same bucket, -1 for the first, per location
+	vector<uint16_t> bucket; // Bucket each location in the queue is in
+	int mask; // Number of buckets minus one (always a power of two, at most MAX_SPAN + 1 buckets)
+	int lowest; // No location in the queue has a lower priority than this
+	int count; // Locations in the queue
+
+	void link(int idx, int priority) {
+		int b = priority & mask;
+		bucket[idx] = b;
+		prev[idx] = -1;
+		next[idx] = head[b];
+		if (head[b] >= 0) {
+			prev[head[b]] = idx;
+		}
+		head[b] = idx;
+	}
+
+	void unlink(int idx) {
+		if (prev[idx] >= 0) {
+			next[prev[idx]] = next[idx];
+		}
+		else {
+			head[bucket[idx]] = next[idx];
+		}
+		if (next[idx] >= 0) {
+			prev[next[idx]] = prev[idx];
+		}
+	}
+
+public:
+
+	BucketQueue() {
+		mask = 0;
+		lowest = 0;
+		count = 0;
+	}
+
+	// Empty the queue for a map of cells locations whose priorities stay within span of each other
+	// The per location arrays only grow, they never need clearing since a location's links
+	// are only read while it is in the queue. A span above MAX_SPAN is a caller's bug: the callers fall back
+	// to a smaller one (search() drops its heuristic) rather than pass it
+	void reset(int cells, int span) {
+		assert(span >= 0 && span <= MAX_SPAN);
+		int buckets = 1;
+		while (buckets <= span) {
+			buckets *= 2;
+		}
+		head.assign(buckets, -1);
+		if ((int)next.size() < cells) {
+			next.resize(cells);
+			prev.resize(cells);
+			bucket.resize(cells);
+		}
+		mask = buckets - 1;
+		lowest = 0;
+		count = 0;
+	}
+
+	bool empty() const {return count == 0;}
+	int size() const {return count;}
+
+	// Add a location that is not in the queue yet
+	void push(int idx, int priority) {
+		if (count == 0 || priority < lowest) {
+			lowest = priority;
+		}
+		link(idx, priority);
+		count++;
+	}
+
+	// Lower the priority of a location already in the queue
+	void decrease(int idx, int priority) {
+		unlink(idx);
+		if (priority < lowest) {
+			lowest = priority;
+		}
+		link(idx, priority);
+	}
+
+	// Lowest priority of any location in the queue, which must not be empty
+	int top() {
+		while (head[lowest & mask] < 0) {
+			lowest++;
+		}
+		return lowest;
+	}
+
+	// Remove and return the location with the lowest priority
+	// Within a priority the most recently added location comes first
+	int pop() {
+		top();
+		int idx = head[lowest & mask];
+		unlink(idx);
+		count--;
+		return idx;
+	}
+};
+
+const int BucketQueue::MAX_SPAN;
+
+// Counters and timings of one search() (see SearchState::stats)
+// Counting costs a few additions per move, so it is always on
+struct SearchStats {
+
+	long long pushed; // Locations added to the open list
+	long long popped; // Locations taken off the open list and expanded
+	long long decreased; // Open locations moved up when a cheaper way to them turned up
+	int maxOpen; // Most locations on the open list at once
+	long long portalMoves; // Moves onto a portal entry, through to its exit
+	long long jumps; // Expansions that jumped across a uniform tile (see SearchState::jumps)
+
+	// Moves out of an expanded location that were not taken, by cause
+	long long rejectedBlocked; // Passing through a 'B'
+	long long rejectedRock; // Landing on an 'R'
+	long long rejectedOutside; // Landing off the map
+	long long rejectedClosed; // Landing on a location already expanded
+	long long rejectedCostlier; // Landing on an open location already reached at least as cheaply
+
+	// Wall-clock time of each phase in microseconds: setting up the search state and heuristic, the search
+	// itself, and tracing the route out of the parent map (left 0 by search(), filled in by whoever traces it)
+	double setupMicros;
+	double searchMicros;
+	double traceMicros;
+
+	SearchStats() {
+		clear();
+	}
+
+	void clear() {
+		pushed = 0;
+		popped = 0;
+		decreased = 0;
+		maxOpen = 0;
+		portalMoves = 0;
+		jumps = 0;
+		rejectedBlocked = 0;
+		rejectedRock = 0;
+		rejectedOutside = 0;
+		rejectedClosed = 0;
+		rejectedCostlier = 0;
+		setupMicros = 0;
+		searchMicros = 0;
+		traceMicros = 0;
+	}
+
+	// Write the stats of query number query as one line of JSON (a JSON lines record)
+	void writeJson(ostream &out, int query, bool found, int cost) const {
+		out << "{\"query\":" << query << ",\"found\":" << (found ? "true" : "false") << ",\"cost\":" << (found ? cost : -1)
+			<< ",\"pushed\":" << pushed << ",\"popped\":" << popped << ",\"decreased\":" << decreased
+			<< ",\"max_open\":" << maxOpen << ",\"portal_moves\":" << portalMoves << ",\"jumps\":" << jumps
+			<< ",\"rejected\":{\"blocked\":" << rejectedBlocked << ",\"rock\":" << rejectedRock
+			<< ",\"outside\":" << rejectedOutside << ",\"closed\":" << rejectedClosed
+			<< ",\"costlier\":" << rejectedCostlier << "}"
+			<< ",\"setup_us\":" << setupMicros << ",\"search_us\":" << searchMicros
+			<< ",\"trace_us\":" << traceMicros << "}\n";
+	}
+};
+
+// Class containing the per-query data of a search
+// A SearchState is scratch space: reuse one per thread across queries so that
+// searching allocates nothing once the buffers have grown to the board size.
+// Nothing is cleared between queries either. Every location carries the generation of the last
+// query that reached it, and anything stamped by an older query reads as unvisited
+class SearchState {
+
+private:
+	int start[2]; // Start point of the search
+	int final[3]; // Final destination of search, if success should = end
+
+	// Generation of the current query, always even: a location stamped generation is open,
+	// generation + 1 is closed, anything else has not been reached by this query
+	uint32_t generation;
+
+public:
+
+	int width; // Width of the map being searched
+	int height; // Height of the map being searched
+
+	// Per location arrays, row-major (index y*width + x), only meaningful where the stamp is current
+	// Stamp Map: Generation stamp, see generation above
+	// Cost Map: The cheapest cost found so far of moving from the start to each location
+	// Parent Map: Index of the location that came before the current one (used to find route back)
+	vector<uint32_t> stampMap;
+	vector<int32_t> costMap;
+	vector<uint32_t> parentMap;
+
+	// The open list, its storage is kept between queries
+	BucketQueue openList;
+
+	// Estimate of the moves left to the end point, set up by the search
+	Heuristic estimate;
+
+	int expanded; // Number of nodes popped off the open list and expanded by the last search
+	int moveOffset[8]; // Index offset of each move the last search made, to trace portal parents (see portalParent())
+
+	// Let search() jump across uniform tiles (see Map::uniformInterior()): a location deep inside one is not
+	// expanded into its 8 moves but straight into the locations on the edge of the tile's inner part, each for
+	// exactly the knight moves it takes to get there. Costs are still the cheapest, with far less on the open list
+	// on open boards. Off by default; searches with no end point never jump
+	bool jumps;
+	SearchStats stats; // Counters and timings of the last search() (other searches leave it cleared)
+
+	SearchState() {
+		width = 0;
+		height = 0;
+		expanded = 0;
+		generation = 0;
+		jumps = false;
+		memset(moveOffset, 0, sizeof(moveOffset));
+		start[0] = -1;
+		start[1] = -1;
+		final[0] = -1;
+		final[1] = -1;
+		final[2] = 0;
+	}
+
+	// Prepare for a new search of map from (startx, starty) whose open list priorities stay within span of each other
+	// Only allocates if the map is bigger than any seen before, otherwise this is O(1)
+	void reset(const Map &map, int startx, int starty, int span) {
+		width = map.width;
+		height = map.height;
+		start[0] = startx;
+		start[1] = starty;
+
+		int cells = width*height;
+		if ((int)stampMap.size() < cells) {
+			stampMap.resize(cells, 0);
+			costMap.resize(cells);
+			parentMap.resize(cells);
+		}
+
+		// Once in four billion queries the stamps wrap around and have to be cleared for real
+		generation += 2;
+		if (generation == 0) {
+			fill(stampMap.begin(), stampMap.end(), 0);
+			generation = 2;
+		}
+
+		openList.reset(cells, span);
+		expanded = 0;
+		stats.clear();
+		memcpy(moveOffset, map.moveOffset, sizeof(moveOffset));
+
+		// Initialize final values as absurd to know if none are assigned
+		final[0] = -1;
+		final[1] = -1;
+		final[2] = 0;
+	}
+
+	bool isOpen(int k) const {return stampMap[k] == generation;}
+	bool isClosed(int k) const {return stampMap[k] == generation + 1;}
+	int getCost(int k) const {return costMap[k];}
+	uint32_t getParent(int k) const {return parentMap[k];}
+
+	int getOpen(int x, int y) const {return isOpen(y*width + x);}
+	int getClosed(int x, int y) const {return isClosed(y*width + x);}
+	int getParentX(int x, int y) const {return (getParent(y*width + x) & PARENT_INDEX) % width;}
+	int getParentY(int x, int y) const {return (getParent(y*width + x) & PARENT_INDEX) / width;}
+	int getCost(int x, int y) const {return getCost(y*width + x);}
+	int getStartX() const {return start[0];}
+	int getStartY() const {return start[1];}
+	int getFinalX() const {return final[0];}
+	int getFinalY() const {return final[1];}
+	int getFinalCost() const {return final[2];}
+
+	// Set the final location of the route
+	void setFinal(int x, int y, int cost) {
+		final[0] = x;
+		final[1] = y;
+		final[2] = cost;
+	}
+
+	void addToOpen(int k) {
+		stampMap[k] = generation;
+	}
+
+	void addToClosed(int k) {
+		stampMap[k] = generation + 1;
+	}
+
+	void setParent(int k, uint32_t parent) {
+		parentMap[k] = parent;
+	}
+
+	void setCost(int k, int cost) {
+		costMap[k] = cost;
+	}
+
+	// Print the entire map that has been searched
+	void printClosedMap() const {
+		for (int j = 0; j < height; j++) {
+			for (int i = 0; i < width; i++) {
+				cout << getClosed(i, j);
+			}
+			cout << '\n';
+		}
+	}
+};
+
+// Relax the jump from location from, reached for cost, to (x, y) in the same uniform region (see jumpAcross())
+// A jump with a priority above limit is put off instead, and rest lowered to its priority. That is decided
+// before anything is read about (x, y), since the locations jumped to are spread all over the region
+static void relaxJump(const Map &map, SearchState &state, const Heuristic &estimate, int scale, int from, int cost,
+					  int x, int y, int limit, int &rest, SearchStats &stats) {
+
+	int elecost = cost + knightDistance(x - from % map.width, y - from / map.width);
+	int priority = elecost + (scale > 0 ? scale*estimate.moves(x, y) : 0);
+	if (priority > limit) {
+		if (rest < 0 || priority < rest) {
+			rest = priority;
+		}
+		return;
+	}
+
+	int k = y*map.width + x;
+	if (state.isClosed(k) || (state.isOpen(k) && state.getCost(k) <= elecost)) {
+		return;
+	}
+
+	if (state.isOpen(k)) {
+		state.openList.decrease(k, priority);
+		stats.decreased++;
+	}
+	else {
+		state.openList.push(k, priority);
+		state.addToOpen(k);
+		stats.pushed++;
+		stats.maxOpen = max(stats.maxOpen, state.openList.size());
+	}
+	state.setCost(k, elecost);
+	state.setParent(k, from);
+}
+
+// Expand location idx, deep inside the uniform tile whose inner part is inner (see Map::uniformInterior()),
+// straight into the outer two rows and columns of inner and into the end point if it is in there, rather than
+// into its 8 moves. Any route on from idx reaches one of those first, and none for less than the knight distance.
+// Only the jumps with a priority of at most limit are made, which on an open board is just the few in line with
+// the end point. Returns the lowest priority of the rest, for idx to come back at and make the next of them
+// (a partial expansion), or -1 if there are none
+static int jumpAcross(const Map &map, SearchState &state, const Heuristic &estimate, int scale, int idx,
+					  const int inner[4], int endx, int endy, int limit, SearchStats &stats) {
+
+	int cost = state.getCost(idx);
+	int rest = -1;
+
+	for (int j = inner[1]; j <= inner[3]; j++) {
+		if (j < inner[1] + 2 || j > inner[3] - 2) {
+			for (int i = inner[0]; i <= inner[2]; i++) {
+				relaxJump(map, state, estimate, scale, idx, cost, i, j, limit, rest, stats);
+			}
+		}
+		else {
+			const int edge[4] = {inner[0], inner[0] + 1, inner[2] - 1, inner[2]};
+			for (int e = 0; e < 4; e++) {
+				relaxJump(map, state, estimate, scale, idx, cost, edge[e], j, limit, rest, stats);
+			}
+		}
+	}
+	if (endx >= inner[0] && endx <= inner[2] && endy >= inner[1] && endy <= inner[3]) {
+		relaxJump(map, state, estimate, scale, idx, cost, endx, endy, limit, rest, stats);
+	}
+	return rest;
+}
+
+// Replace each jump on the route from location start to location end in the state's parent map with knight moves.
+// Both ends of a jump are in the inner part of a uniform region, where any two locations have a route of exactly the
+// knight distance inside the region, which is all the jump was charged. So the route steps greedily to a location
+// of the inner part one move nearer the far end, and if there is none left, finishes with a breadth-first search
+// of the box around the two ends widened by two, which always holds such a route. A cheapest route never
+// visits a location twice, so nothing else on the route is overwritten
+static void spliceJumps(const Map &map, SearchState &state, int start, int end) {
+
+	vector<int> prev;
+	vector<int> queue;
+	for (int k = end; k != start; ) {
+
+		uint32_t parent = state.getParent(k);
+		int from = parent & PARENT_INDEX;
+		int kx = k % map.width;
+		int ky = k / map.width;
+		int dx = kx - from % map.width;
+		int dy = ky - from / map.width;
+		if ((parent & VIA_PORTAL) || dx*dx + dy*dy == 5) {
+			k = from;
+			continue;
+		}
+
+		int inner[4];
+		map.uniformInterior(from % map.width, from / map.width, inner);
+
+		// Step greedily from the far end back towards from, each step's parent the one taken after it
+		int at = k;
+		int ax = kx;
+		int ay = ky;
+		int left = knightDistance(ax - from % map.width, ay - from / map.width);
+		while (left > 0) {
+			int i = 0;
+			for (; i < 8; i++) {
+				int x = ax + dirmap[i][0];
+				int y = ay + dirmap[i][1];
+				if (x >= inner[0] && x <= inner[2] && y >= inner[1] && y <= inner[3] &&
+					knightDistance(x - from % map.width, y - from / map.width) == left - 1) {
+					break;
+				}
+			}
+			if (i == 8) {
+				break;
+			}
+			int next = at + map.moveOffset[i];
+			state.setParent(at, next);
+			at = next;
+			ax += dirmap[i][0];
+			ay += dirmap[i][1];
+			left--;
+		}
+
+		// Breadth-first search from from for the rest, in the box around it and at widened by two
+		if (left > 0) {
+			int x0 = min(ax, from % map.width) - 2;
+			int y0 = min(ay, from / map.width) - 2;
+			int bw = abs(ax - from % map.width) + 5;
+			int bh = abs(ay - from / map.width) + 5;
+			int origin = (from / map.width - y0)*bw + (from % map.width - x0);
+			int target = (ay - y0)*bw + (ax - x0);
+			prev.assign(bw*bh, -1);
+			queue.assign(1, origin);
+			prev[origin] = origin;
+			for (size_t head = 0; head < queue.size() && prev[target] < 0; head++) {
+				int c = queue[head];
+				for (int i = 0; i < 8; i++) {
+					int x = c % bw + dirmap[i][0];
+					int y = c / bw + dirmap[i][1];
+					if (x >= 0 && x < bw && y >= 0 && y < bh && prev[y*bw + x] < 0) {
+						prev[y*bw + x] = c;
+						queue.push_back(y*bw + x);
+					}
+				}
+			}
+			for (int c = target; c != origin; c = prev[c]) {
+				state.setParent((y0 + c / bw)*map.width + x0 + c % bw, (y0 + prev[c] / bw)*map.width + x0 + prev[c] % bw);
+			}
+		}
+		k = from;
+	}
+}
+
+// A* search algorithm to find end point
+// The map is only read, everything the search records goes into state
+// Returns true if the end point was reached
+// With useHeuristic false every node is ordered by cost alone (uniform-cost search), which is
+// useful for measuring how many expansions the heuristic saves (see SearchState::expanded)
+// A location already on the open list is moved up whenever a cheaper way to it turns up, and since the
+// heuristic is consistent a closed location is never improved on, so the route found is the cheapest
+// With an end point of (-1, -1) there is no goal: the search runs until every reachable location is
+// closed, leaving the cheapest cost and parent of each in state (see CostField)
+// What the search did is counted in state.stats (see SearchStats). With state.jumps set it jumps across
+// uniform tiles (see SearchState::jumps)
+bool search(const Map &map, SearchState &state, int startx, int starty, int endx, int endy,
+			bool useHeuristic = true, Objective objective = CHEAPEST) {
+
+	chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+
+	// Counted locally while searching and copied into state.stats at the end
+	SearchStats stats;
+
+	// Helper variables for calculations in search
+	int currdirx;
+	int currdiry;
+	int landx;
+	int landy;
+	int elecost;
+
+	// Every move costs at least the heuristic's scale: minCost, or one when counting moves
+	bool exhaust = (endx == -1 && endy == -1);
+	int scale = (objective == FEWEST_MOVES) ? 1 : map.minCost;
+	if (!useHeuristic || exhaust) {
+		scale = 0;
+	}
+
+	// A move can add at most maxCost to a node's cost and the scale times the estimate's growth to its heuristic
+	if (scale > 0) {
+		state.estimate.reset(map, endx, endy);
+	}
+	int span = (objective == FEWEST_MOVES ? 1 : map.maxCost) + scale*state.estimate.getGrowth();
+
+	// A portal whose exit is far from its entry can let the estimate grow by more than the open list can span,
+	// then the search goes without it
+	if (span > BucketQueue::MAX_SPAN) {
+		scale = 0;
+		span = (objective == FEWEST_MOVES ? 1 : map.maxCost);
+	}
+
+	// A jump raises the priority by up to its moves plus as much again times the estimate's growth,
+	// which has to fit in the open list's span
+	int jump = knightDistance(3*Map::UNIFORM_TILE - 5, 3*Map::UNIFORM_TILE - 5)*(1 + scale*state.estimate.getGrowth());
+	bool jumping = state.jumps && !exhaust && max(span, jump) <= BucketQueue::MAX_SPAN;
+	if (jumping) {
+		span = max(span, jump);
+	}
+
+	state.reset(map, startx, starty, span);
+	BucketQueue &openpq = state.openList;
+	const Heuristic &estimate = state.estimate;
+
+	if (startx < 0 || startx >= map.width || starty < 0 || starty >= map.height ||
+		(!exhaust && (endx < 0 || endx >= map.width || endy < 0 || endy >= map.height))) {
+		stats.setupMicros = chrono::duration<double, micro>(chrono::steady_clock::now() - t0).count();
+		state.stats = stats;
+		return false;
+	}
+
+	// Set the parent of the starting point to itself
+	int start = starty*map.width + startx;
+	state.setParent(start, start);
+	state.setCost(start, 0);
+	state.addToOpen(start);
+	openpq.push(start, scale > 0 ? scale*estimate.moves(startx, starty) : 0);
+	stats.pushed = 1;
+	stats.maxOpen = 1;
+	chrono::steady_clock::time_point t1 = chrono::steady_clock::now();
+	bool found = false;
+
+	// Loop through sorted search elements until we arrive at the end
+	int inner[4];
+	while (!openpq.empty()) {
+
+		// Pop our current position off the open list
+		int popped = jumping ? openpq.top() : 0;
+		int idx = openpq.pop();
+
+		// A location already jumped from is back for the next of the jumps it put off
+		if (jumping && state.isClosed(idx)) {
+			map.uniformInterior(idx % map.width, idx / map.width, inner);
+			int rest = jumpAcross(map, state, estimate, scale, idx, inner, endx, endy, popped, stats);
+			if (rest >= 0) {
+				openpq.push(idx, rest);
+				stats.pushed++;
+			}
+			continue;
+		}
+
+		Node current(idx % map.width, idx / map.width, state.getCost(idx));
+		state.expanded++;
+
+		// Add this point to the closed map to indicate that its neighbors have been searched
+		state.addToClosed(idx);
+
+		// Stop if we are at the goal, set the final resting position
+		if (current.x == endx && current.y == endy) {
+			state.setFinal(current.x, current.y, current.cost);
+			found = true;
+			break;
+		}
+
+		// Deep inside a uniform tile, jump to its edge instead, putting off the jumps that are not needed yet
+		if (jumping && map.uniformInterior(current.x, current.y, inner)) {
+			stats.jumps++;
+			int rest = jumpAcross(map, state, estimate, scale, idx, inner, endx, endy, popped, stats);
+			if (rest >= 0) {
+				openpq.push(idx, rest);
+				stats.pushed++;
+			}
+			continue;
+		}
+
+		// Put the moves the move table rules out down to their cause: off the map, onto a rock,
+		// or (the only other way a move is illegal) through a block
+		for (unsigned int illegal = ~map.getMoves(idx) & 0xff; illegal != 0; illegal &= illegal - 1) {
+			int i = __builtin_ctz(illegal);
+			int x = current.x + dirmap[i][0];
+			int y = current.y + dirmap[i][1];
+			if (x < 0 || x >= map.width || y < 0 || y >= map.height) {
+				stats.rejectedOutside++;
+			}
+			else if (map.getChar(x, y) == 'R') {
+				stats.rejectedRock++;
+			}
+			else {
+				stats.rejectedBlocked++;
+			}
+		}
+
+		// Run through the legal next positions, one set bit of the move table at a time
+		for (unsigned int moves = map.getMoves(idx); moves != 0; moves &= moves - 1) {
+
+			int i = __builtin_ctz(moves);
+
+			// Define utility variables to store position plus direction movements and update cost function
+			int next = idx + map.moveOffset[i];
+			currdirx = current.x + dirmap[i][0];
+			currdiry = current.y + dirmap[i][1];
+			elecost = current.cost + (objective == FEWEST_MOVES ? 1 : map.getCost(next));
+
+			// Landing on a portal entry puts us on its exit, the portal itself adds no extra cost.
+			// The exit's parent records the move onto the entry (see portalParent()), so that
+			// reconstructPath() can add the entry that was landed on back into the route
+			uint32_t parent = idx;
+			int exit = map.getPortalExit(next);
+			if (exit >= 0) {
+				next = exit;
+				landx = exit % map.width;
+				landy = exit / map.width;
+				parent = portalParent(idx, i);
+				stats.portalMoves++;
+			}
+			else {
+				landx = currdirx;
+				landy = currdiry;
+			}
+
+			// Nothing more to do if the landing point has already been searched,
+			// or has already been reached at least as cheaply
+			if (state.isClosed(next)) {
+				stats.rejectedClosed++;
+				continue;
+			}
+			if (state.isOpen(next) && state.getCost(next) <= elecost) {
+				stats.rejectedCostlier++;
+				continue;
+			}
+
+			int priority = elecost + (scale > 0 ? scale*estimate.moves(landx, landy) : 0);
+
+			if (state.isOpen(next)) {
+				openpq.decrease(next, priority);
+				stats.decreased++;
+			}
+			else {
+				openpq.push(next, priority);
+				state.addToOpen(next);
+				stats.pushed++;
+				stats.maxOpen = max(stats.maxOpen, openpq.size());
+			}
+			state.setCost(next, elecost);
+			state.setParent(next, parent);
+		}
+	}
+
+	// If there is no route, return the start points, and 0 cost for our final rest point
+	if (!found) {
+		state.setFinal(startx, starty, 0);
+	}
+	else if (jumping) {
+		spliceJumps(map, state, start, endy*map.width + endx);
+	}
+
+	stats.popped = state.expanded;
+	stats.setupMicros = chrono::duration<double, micro>(t1 - t0).count();
+	stats.searchMicros = chrono::duration<double, micro>(chrono::steady_clock::now() - t1).count();
+	state.stats = stats;
+	return found;
+}
+
+// Search from the map's own start point ('S') to its end point ('E')
+bool search(const Map &map, SearchState &state, bool useHeuristic = true) {
+	return search(map, state, map.getStartX(), map.getStartY(), map.getEndX(), map.getEndY(), useHeuristic);
+}
+
+// Pick the estimate a searchMoves() kernel uses: its own for most move sets, the search state's for knights
+template <class Moves>
+BasicHeuristic<Moves> &kernelEstimate(SearchState &, BasicHeuristic<Moves> &local) {return local;}
+
+inline Heuristic &kernelEstimate(SearchState &state, Heuristic &) {return state.estimate;}
+
+// The A* of search() for the move set Moves (see Leaper), on a board Width wide (or any width if 0)
+// Everything about a move is known when it is compiled: its (dx, dy), and so its index offset too when the width
+// is, and its footprint, so the loop over the 8 moves unrolls with no table of directions to read. Knight moves are
+// read off the map's move table, any other set is checked here, by bounds, an 'R' where it lands and a 'B' on
+// its footprint. Portals, parents, costs and the open list all work as in search(), for the cheapest route
+template <class Moves, int Width>
+bool searchMovesKernel(const Map &map, SearchState &state, int startx, int starty, int endx, int endy) {
+
+	const int width = Width > 0 ? Width : map.width;
+	const int height = map.height;
+
+	// Index offset of each step, and of each location of its footprint
+	int offset[8];
+	int footprint[8][Moves::footprint];
+	int footprintSize[8];
+	for (int i = 0; i < 8; i++) {
+		int cells[Moves::footprint][2];
+		offset[i] = Moves::steps[i][1]*width + Moves::steps[i][0];
+		footprintSize[i] = moveFootprint(Moves::steps[i][0], Moves::steps[i][1], cells);
+		for (int f = 0; f < footprintSize[i]; f++) {
+			footprint[i][f] = cells[f][1]*width + cells[f][0];
+		}
+	}
+
+	bool exhaust = (endx == -1 && endy == -1);
+	int scale = exhaust ? 0 : map.minCost;
+	BasicHeuristic<Moves> local;
+	BasicHeuristic<Moves> &estimate = kernelEstimate(state, local);
+	if (scale > 0) {
+		estimate.reset(map, endx, endy);
+	}
+	int span = map.maxCost + scale*estimate.getGrowth();
+	if (span > BucketQueue::MAX_SPAN) {
+		scale = 0; // Without the estimate, as in search()
+		span = map.maxCost;
+	}
+	state.reset(map, startx, starty, span);
+	memcpy(state.moveOffset, offset, sizeof(offset));
+	BucketQueue &openpq = state.openList;
+
+	if (startx < 0 || startx >= width || starty < 0 || starty >= height ||
+		(!exhaust && (endx < 0 || endx >= width || endy < 0 || endy >= height))) {
+		return false;
+	}
+
+	int start = starty*width + startx;
+	state.setParent(start, start);
+	state.setCost(start, 0);
+	state.addToOpen(start);
+	openpq.push(start, scale > 0 ? scale*estimate.moves(startx, starty) : 0);
+
+	const char *terrain = &map.map[0];
+	while (!openpq.empty()) {
+
+		int idx = openpq.pop();
+		int x = idx % width;
+		int y = idx / width;
+		int cost = state.getCost(idx);
+		state.expanded++;
+		state.addToClosed(idx);
+
+		if (x == endx && y == endy) {
+			state.setFinal(x, y, cost);
+			return true;
+		}
+
+		unsigned int legal = Moves::tabled ? map.getMoves(idx) : 0xff;
+		for (int i = 0; i < 8; i++) {
+
+			int landx = x + Moves::steps[i][0];
+			int landy = y + Moves::steps[i][1];
+			int next = idx + offset[i];
+
+			if (Moves::tabled) {
+				if (!(legal & (1 << i))) {
+					continue;
+				}
+			}
+			else {
+				if ((unsigned int)landx >= (unsigned int)width || (unsigned int)landy >= (unsigned int)height ||
+					terrain[next] == 'R') {
+					continue;
+				}
+				bool blocked = false;
+				for (int f = 0; f < footprintSize[i]; f++) {
+					blocked |= (terrain[idx + footprint[i][f]] == 'B');
+				}
+				if (blocked) {
+					continue;
+				}
+			}
+
+			int elecost = cost + map.getCost(next);
+			uint32_t parent = idx;
+			int exit = map.getPortalExit(next);
+			if (exit >= 0) {
+				next = exit;
+				landx = exit % width;
+				landy = exit / width;
+				parent = portalParent(idx, i);
+			}
+
+			if (state.isClosed(next) || (state.isOpen(next) && state.getCost(next) <= elecost)) {
+				continue;
+			}
+
+			int priority = elecost + (scale > 0 ? scale*estimate.moves(landx, landy) : 0);
+			if (state.isOpen(next)) {
+				openpq.decrease(next, priority);
+			}
+			else {
+				openpq.push(next, priority);
+				state.addToOpen(next);
+			}
+			state.setCost(next, elecost);
+			state.setParent(next, parent);
+		}
+	}
+
+	state.setFinal(startx, starty, 0);
+	return false;
+}
+
+// Cheapest route from (startx, starty) to (endx, endy) moving like Moves (see Leaper and King), read back with
+// tracePath() like any other search. The boards of the original challenge, 8 and 32 wide, get kernels of their own
+// with every offset a constant, any other width the kernel that reads it from the map
+template <class Moves>
+bool searchMoves(const Map &map, SearchState &state, int startx, int starty, int endx, int endy) {
+	if (map.width == 8) {
+		return searchMovesKernel<Moves, 8>(map, state, startx, starty, endx, endy);
+	}
+	if (map.width == 32) {
+		return searchMovesKernel<Moves, 32>(map, state, startx, starty, endx, endy);
+	}
+	return searchMovesKernel<Moves, 0>(map, state, startx, starty, endx, endy);
+}
+
+// Relax a move of one side of searchBidirectional() to location next for cost, with the given parent map entry
+// The other side's cost to next, if it has one, completes a route which is kept if it is the cheapest yet
+static void relaxBidirectional(SearchState &side, const SearchState &other, uint32_t parent, int next, int cost,
+							   int &best, int &meet) {
+
+	if (side.isClosed(next) || (side.isOpen(next) && side.getCost(next) <= cost)) {
+		return;
+	}
+	if (side.isOpen(next)) {
+		side.openList.decrease(next, cost);
+	}
+	else {
+		side.openList.push(next, cost);
+		side.addToOpen(next);
+	}
+	side.setCost(next, cost);
+	side.setParent(next, parent);
+
+	if ((other.isOpen(next) || other.isClosed(next)) && (best < 0 || cost + other.getCost(next) < best)) {
+		best = cost + other.getCost(next);
+		meet = next;
+	}
+}
+
+// Bidirectional search: a uniform-cost search forward from the start and another backward from the end,
+// each growing a disc about half as wide as the single search's would be.
+// The forward side follows the move table out of each location as search() does.
+// The backward side follows the reverse move table into each location, and its cost at a location is
+// the cost of moving from there to the end. A location can be stood on by landing on it (unless it is
+// a portal entry) or on the entry of any portal leading to it, so the backward side steps from it to the
+// moves into each of those (see Map::nextLanding()). Its parent map holds the location after each one,
+// with the move onto the portal entry recorded the same way as the forward side's when there is one.
+// The side with fewer locations open is expanded next. Whenever a move reaches a location the other side
+// has a cost for, the two costs make a route. Once the lowest costs on the two open lists add up to at least
+// the cheapest such route, no route through a location neither side has closed can be cheaper, so it is the answer.
+// The meeting location and the cost of the whole route are left as both states' final values,
+// and the two parent maps are stitched together by traceBidirectional()
+bool searchBidirectional(const Map &map, SearchState &forward, SearchState &backward, int startx, int starty,
+						 int endx, int endy, Objective objective = CHEAPEST) {
+
+	int span = (objective == FEWEST_MOVES) ? 1 : map.maxCost;
+	forward.reset(map, startx, starty, span);
+	backward.reset(map, endx, endy, span);
+
+	if (startx < 0 || startx >= map.width || starty < 0 || starty >= map.height ||
+		endx < 0 || endx >= map.width || endy < 0 || endy >= map.height) {
+		return false;
+	}
+
+	int start = starty*map.width + startx;
+	int end = endy*map.width + endx;
+	forward.setParent(start, start);
+	forward.setCost(start, 0);
+	forward.addToOpen(start);
+	forward.openList.push(start, 0);
+	backward.setParent(end, end);
+	backward.setCost(end, 0);
+	backward.addToOpen(end);
+	backward.openList.push(end, 0);
+
+	// Cheapest route found so far (-1 for none yet) and the location its two halves meet at
+	int best = -1;
+	int meet = -1;
+	if (start == end) {
+		best = 0;
+		meet = start;
+	}
+
+	// Once either side runs out of locations, every route has been seen
+	while (!forward.openList.empty() && !backward.openList.empty()) {
+
+		if (best >= 0 && forward.openList.top() + backward.openList.top() >= best) {
+			break;
+		}
+
+		if (forward.openList.size() <= backward.openList.size()) {
+
+			int idx = forward.openList.pop();
+			int cost = forward.getCost(idx);
+			forward.addToClosed(idx);
+			forward.expanded++;
+
+			for (unsigned int moves = map.getMoves(idx); moves != 0; moves &= moves - 1) {
+				int i = __builtin_ctz(moves);
+				int next = idx + map.moveOffset[i];
+				int elecost = cost + (objective == FEWEST_MOVES ? 1 : map.getCost(next));
+				int exit = map.getPortalExit(next);
+				if (exit >= 0) {
+					relaxBidirectional(forward, backward, portalParent(idx, i), exit, elecost, best, meet);
+				}
+				else {
+					relaxBidirectional(forward, backward, idx, next, elecost, best, meet);
+				}
+			}
+		}
+		else {
+
+			int idx = backward.openList.pop();
+			int cost = backward.getCost(idx);
+			backward.addToClosed(idx);
+			backward.expanded++;
+
+			// Each location a knight can land on to end up standing here
+			for (int landing = map.nextLanding(idx, -1); landing >= 0; landing = map.nextLanding(idx, landing)) {
+				int elecost = cost + (objective == FEWEST_MOVES ? 1 : map.getCost(landing));
+				for (unsigned int moves = map.getReverseMoves(landing); moves != 0; moves &= moves - 1) {
+					int i = __builtin_ctz(moves);
+					int prev = landing - map.moveOffset[i];
+					relaxBidirectional(backward, forward, landing == idx ? (uint32_t)idx : portalParent(idx, i),
+									   prev, elecost, best, meet);
+				}
+			}
+		}
+	}
+
+	if (best < 0) {
+		forward.setFinal(startx, starty, 0);
+		backward.setFinal(endx, endy, 0);
+		return false;
+	}
+	forward.setFinal(meet % map.width, meet / map.width, best);
+	backward.setFinal(meet % map.width, meet / map.width, best);
+	return true;
+}
+
+// Number of locations on the route in a map of parent location indices from location start to location end,
+// both included, counting each portal entry landed on
+int routeLength(const uint32_t *parents, int start, int end) {
+	int n = 1;
+	for (int k = end; k != start; k = parents[k] & PARENT_INDEX) {
+		n += (parents[k] & VIA_PORTAL) ? 2 : 1;
+	}
+	return n;
+}
+
+// Writes the route in a map of parent location indices from location start to location end into route,
+// as location indices start first. The parents are followed back from the end once to count the route and
+// once more to fill it in from the back, so it is written in place with nothing to reverse.
+// Portal parents are traced with the given move offsets, the map's knight moves if none.
+// Returns the number of locations on the route; if that is more than capacity, nothing is written
+int writeRoute(const Map &map, const uint32_t *parents, int start, int end, uint32_t *route, int capacity,
+			   const int *moveOffset = NULL) {
+
+	if (moveOffset == NULL) {
+		moveOffset = map.moveOffset;
+	}
+
+	int n = routeLength(parents, start, end);
+	if (n > capacity) {
+		return n;
+	}
+
+	int at = n - 1;
+	route[at] = end;
+	for (int k = end; k != start; ) {
+
+		// Coming through a portal, the entry that was landed on goes between here and the parent
+		uint32_t parent = parents[k];
+		k = parent & PARENT_INDEX;
+		if (parent & VIA_PORTAL) {
+			route[--at] = k + moveOffset[(parent >> 28) & 7];
+		}
+		route[--at] = k;
+	}
+	return n;
+}
+
+// Writes the route recorded in the search state into route, see above
+int writeRoute(const Map &map, const SearchState &state, uint32_t *route, int capacity) {
+	return writeRoute(map, &state.parentMap[0], state.getStartY()*map.width + state.getStartX(),
+					  state.getFinalY()*map.width + state.getFinalX(), route, capacity, state.moveOffset);
+}
+
+// Follows a map of parent location indices back from (endx, endy) to (startx, starty)
+// Fills total_path with the locations in that order (end first), reusing its storage.
+// Portal parents are traced with the given move offsets, the map's knight moves if none
+void traceParents(const Map &map, const uint32_t *parents, int startx, int starty, int endx, int endy,
+				  vector<Node> &total_path, const int *moveOffset = NULL) {
+
+	if (moveOffset == NULL) {
+		moveOffset = map.moveOffset;
+	}
+
+	int start = starty*map.width + startx;
+	int k = endy*map.width + endx;
+
+	// Size the path once, then follow the map of parent nodes back to the map start point
+	total_path.resize(routeLength(parents, start, k));
+	size_t at = 0;
+	total_path[at++] = Node(endx, endy);
+	while (k != start) {
+
+		// Coming through a portal, the entry that was landed on goes between here and the parent
+		uint32_t parent = parents[k];
+		int from = parent & PARENT_INDEX;
+		if (parent & VIA_PORTAL) {
+			int entry = from + moveOffset[(parent >> 28) & 7];
+			total_path[at++] = Node(entry % map.width, entry / map.width);
+		}
+		k = from;
+		total_path[at++] = Node(k % map.width, k / map.width);
+	}
+}
+
+// Follows the route recorded in the search state back from the end point to the start
+// Fills total_path with the locations in that order (end first), reusing its storage
+void tracePath(const Map &map, const SearchState &state, vector<Node> &total_path) {
+	traceParents(map, &state.parentMap[0], state.getStartX(), state.getStartY(),
+				 state.getFinalX(), state.getFinalY(), total_path, state.moveOffset);
+}
+
+// Stitches the two halves of a route found by searchBidirectional() together
+// Fills total_path with the locations from the end point back to the start, reusing its storage
+void traceBidirectional(const Map &map, const SearchState &forward, const SearchState &backward,
+						vector<Node> &total_path) {
+
+	// The forward half, from the meeting location back to the start
+	vector<Node> half;
+	tracePath(map, forward, half);
+
+	// The backward half, following each location's successor from the meeting location on to the end
+	total_path.clear();
+	int k = forward.getFinalY()*map.width + forward.getFinalX();
+	int end = backward.getStartY()*map.width + backward.getStartX();
+	while (k != end) {
+		uint32_t parent = backward.getParent(k);
+		int next = parent & PARENT_INDEX;
+
+		// Going through a portal, the entry landed on comes first
+		if (parent & VIA_PORTAL) {
+			int entry = k + map.moveOffset[(parent >> 28) & 7];
+			total_path.push_back(Node(entry % map.width, entry / map.width));
+		}
+		total_path.push_back(Node(next % map.width, next / map.width));
+		k = next;
+	}
+
+	reverse(total_path.begin(), total_path.end());
+	total_path.insert(total_path.end(), half.begin(), half.end());
+}
+
+// Prints the original map, then the route (end first) drawn over it and its cost
+// Everything is rendered into one buffer and written out at once
+void printRoute(const Map &map, const vector<Node> &total_path, int cost) {
+
+	string out = "Original Map:\n";
+	out.reserve(2*map.height*(map.width + 1) + 64);
+	map.renderMap(out);
+	out += "\nMap of Moves:\n";
+
+	// Mark 'K' on map where we have moved to (everywhere but the start)
+	size_t moves = out.size();
+	map.renderMap(out);
+	for (size_t k = 0; k+1 < total_path.size(); k++) {
+		out[moves + total_path[k].y*(map.width + 1) + total_path[k].x] = 'K';
+	}
+
+	out += "Cost of Movement: " + to_string(cost) + "\n";
+	cout.write(out.data(), out.size());
+}
+
+// Writes a route (location indices, start first, see writeRoute()) as CSV: an "x,y" header, then a line per location
+// The lines are formatted into one buffer, written out at once
+bool writeRouteCsv(ostream &out, const Map &map, const uint32_t *route, int n) {
+	string text = "x,y\n";
+	text.reserve(text.size() + n*12);
+	for (int k = 0; k < n; k++) {
+		text += to_string(route[k] % map.width);
+		text += ',';
+		text += to_string(route[k] / map.width);
+		text += '\n';
+	}
+	out.write(text.data(), text.size());
+	return out.good();
+}
+
+// Writes a route (location indices, start first, see writeRoute()) in the binary route format (see the top of
+// this file): a 20 byte header and then the location indices as they are, with no formatting at all
+bool writeRouteBinary(ostream &out, const Map &map, const uint32_t *route, int n, int cost) {
+
+	// Fields are written out byte by byte so that the file is little-endian whatever the machine is
+	uint32_t header[4] = {(uint32_t)map.width, (uint32_t)map.height, (uint32_t)n, (uint32_t)cost};
+	unsigned char bytes[20] = {'K', 'B', 'R', 'T'};
+	for (int f = 0; f < 4; f++) {
+		for (int b = 0; b < 4; b++) {
+			bytes[4 + 4*f + b] = header[f] >> (8*b);
+		}
+	}
+	out.write((const char *)bytes, sizeof(bytes));
+
+	uint32_t one = 1;
+	if (*(const unsigned char *)&one == 1) {
+		out.write((const char *)route, (streamsize)n*sizeof(uint32_t));
+	}
+	else {
+		for (int k = 0; k < n; k++) {
+			for (int b = 0; b < 4; b++) {
+				out.put((char)(route[k] >> (8*b)));
+			}
+		}
+	}
+	return out.good();
+}
+
+// Reconstructs the path back from the end point to the start
+// Via the route recorded in the search state, and prints it over the map
+vector<Node> reconstructPath(const Map &map, const SearchState &state) {
+	
+	vector<Node> total_path;  // Vector of the path back to the start
+	tracePath(map, state, total_path);
+	printRoute(map, total_path, state.getFinalCost());
+
+	return total_path;
+}
+
+// Function that verifies a sequence of moves
+// The path runs end first like tracePath(). Every step must be a knight move, except that landing on a
+// portal entry must be followed straight away by its exit (where the knight then stands, even on another entry)
+// The verdict is printed unless report is false
+bool verifySequence(const vector<Node> &total_path, const Map &map, bool report = true) {
+
+	// Step from each location to the one after it, start first
+	bool standing = true;
+	for (size_t i = total_path.size(); i > 1; i--) {
+
+		const Node &from = total_path[i-1];
+		const Node &to = total_path[i-2];
+
+		// A location landed on that is a portal entry
+		int exit = -1;
+		if (!standing && from.x >= 0 && from.x < map.width && from.y >= 0 && from.y < map.height) {
+			exit = map.getPortalExit(from.y*map.width + from.x);
+		}
+
+		bool valid;
+		if (exit >= 0) {
+			valid = (to.y*map.width + to.x == exit);
+			standing = true;
+		}
+		else {
+			valid = ((abs(from.x - to.x) == 1 && abs(from.y - to.y) == 2) ||
+					 (abs(from.x - to.x) == 2 && abs(from.y - to.y) == 1));
+			standing = false;
+		}
+		if (!valid) {
+			if (report) {
+				cout << "The sequence failed to pass inspection.\n";
+			}
+			return false;
+		}
+	}
+	if (report) {
+		cout << "The sequence successfully passed inspection.\n";
+	}
+	return true;
+}
+
+// Outcome of checking a route with validateRoute()
+enum RouteStatus {
+	ROUTE_VALID, // Every step is legal
+	ROUTE_EMPTY, // No locations at all
+	ROUTE_OUTSIDE, // A location is off the map
+	ROUTE_NOT_KNIGHT_MOVE, // A step is not a knight move
+	ROUTE_BLOCKED, // A step passes through a 'B' (see Map::moveBlocked())
+	ROUTE_ROCK, // A step lands on an 'R'
+	ROUTE_MISSED_PORTAL // A step out of a portal entry that was landed on does not go to its exit
+};
+
+static const char *const routeStatusNames[] = {"valid", "empty", "outside", "not-knight-move", "blocked", "rock", "missed-portal"};
+
+// Verdict on one route: its status, the index of the first location that breaks it (-1 if valid),
+// and the cost of moving along it (the cost of every location landed on, as search() counts it) if valid
+struct RouteVerdict {
+	int32_t cost;
+	int32_t failedAt;
+	uint8_t status;
+};
+
+// Many routes, start first, held as structure of arrays: route r is locations offsets[r] to offsets[r+1] - 1
+// of x and y, so a validator streams through each coordinate array in order
+struct RouteBatch {
+
+	vector<int32_t> x;
+	vector<int32_t> y;
+	vector<uint32_t> offsets;
+
+	RouteBatch() : x(), y(), offsets(1, 0) {}
+
+	int size() const {return offsets.size() - 1;}
+
+	void clear() {
+		x.clear();
+		y.clear();
+		offsets.assign(1, 0);
+	}
+
+	// Append a route of n locations, start first
+	void add(const int32_t *xs, const int32_t *ys, int n) {
+		x.insert(x.end(), xs, xs + n);
+		y.insert(y.end(), ys, ys + n);
+		offsets.push_back(x.size());
+	}
+};
+
+// dirmap index of the knight move (dx, dy) at knightMoveIndex[(dy+2)*5 + dx+2], 8 if it is not a knight move
+// (shifting a move table entry by 8 leaves nothing, so that reads as illegal without a branch)
+static const uint8_t knightMoveIndex[25] = {
+	8, 5, 8, 6, 8,
+	4, 8, 8, 8, 7,
+	8, 8, 8, 8, 8,
+	3, 8, 8, 8, 0,
+	8, 2, 8, 1, 8
+};
+
+// Index into knightMoveIndex of the step (dx, dy), the middle (not a move) if it is more than two either way
+inline unsigned int knightMoveCell(int dx, int dy) {
+	unsigned int x = dx + 2;
+	unsigned int y = dy + 2;
+	return (x < 5 && y < 5) ? y*5 + x : 12;
+}
+
+// Check the route of n locations (xs[k], ys[k]), start first, for full legality on map and work out its cost.
+// Everything is read from the map's tables, nothing is printed.
+// The common case is a legal route that never lands on a portal entry, so it is checked first by loops with no
+// branches and no early exit. The first is pure arithmetic on the coordinate arrays, which the compiler vectorizes:
+// every location on the map and every step a knight move (dx*dx + dy*dy == 5). The second looks up each step's
+// move table bit, the cost of landing and whether a portal entry was landed on, one byte load each (bytes cannot
+// be gathered into vectors, so it stays scalar, but it never branches).
+// Only a route that fails or lands on a portal entry is walked again one step at a time to find out why,
+// or to follow its portals the way verifySequence() does
+RouteVerdict validateRoute(const Map &map, const int32_t *xs, const int32_t *ys, int n) {
+
+	RouteVerdict verdict;
+	verdict.cost = 0;
+	verdict.failedAt = -1;
+	verdict.status = ROUTE_VALID;
+	if (n <= 0) {
+		verdict.status = ROUTE_EMPTY;
+		verdict.failedAt = 0;
+		return verdict;
+	}
+
+	const int w = map.width;
+	const int h = map.height;
+
+	unsigned int outside = ((unsigned int)xs[0] >= (unsigned int)w) | ((unsigned int)ys[0] >= (unsigned int)h);
+	unsigned int stray = 0;
+	for (int k = 1; k < n; k++) {
+		int dx = xs[k] - xs[k-1];
+		int dy = ys[k] - ys[k-1];
+		outside |= ((unsigned int)xs[k] >= (unsigned int)w) | ((unsigned int)ys[k] >= (unsigned int)h);
+		stray |= (dx*dx + dy*dy != 5);
+	}
+
+	if (!outside && !stray) {
+		const unsigned char *moves = &map.moveMap[0];
+		const uint8_t *costs = &map.costMap[0];
+		const int16_t *entries = &map.portalMap[0];
+		unsigned int legal = 1;
+		int landed = 0;
+		int cost = 0;
+		for (int k = 0; k + 1 < n; k++) {
+			unsigned int move = knightMoveIndex[(ys[k+1] - ys[k] + 2)*5 + xs[k+1] - xs[k] + 2];
+			int to = ys[k+1]*w + xs[k+1];
+			legal &= moves[ys[k]*w + xs[k]] >> move;
+			cost += costs[to];
+			landed |= entries[to] >= 0;
+		}
+		if ((legal & 1) && !landed) {
+			verdict.cost = cost;
+			return verdict;
+		}
+	}
+
+	// Walk the route a step at a time: find the first location or step that breaks it, following portals
+	bool standing = true;
+	int cost = 0;
+	for (int k = 0; k < n; k++) {
+
+		if ((unsigned int)xs[k] >= (unsigned int)w || (unsigned int)ys[k] >= (unsigned int)h) {
+			verdict.status = ROUTE_OUTSIDE;
+			verdict.failedAt = k;
+			return verdict;
+		}
+		if (k == 0) {
+			continue;
+		}
+
+		int from = ys[k-1]*w + xs[k-1];
+		int to = ys[k]*w + xs[k];
+
+		// A location landed on that is a portal entry is left for its exit, at no cost
+		int exit = standing ? -1 : map.getPortalExit(from);
+		if (exit >= 0) {
+			if (to != exit) {
+				verdict.status = ROUTE_MISSED_PORTAL;
+				verdict.failedAt = k;
+				return verdict;
+			}
+			standing = true;
+			continue;
+		}
+
+		int move = knightMoveIndex[knightMoveCell(xs[k] - xs[k-1], ys[k] - ys[k-1])];
+		if (move == 8) {
+			verdict.status = ROUTE_NOT_KNIGHT_MOVE;
+		}
+		else if (!(map.getMoves(from) & (1 << move))) {
+			verdict.status = map.getChar(to) == 'R' ? ROUTE_ROCK : ROUTE_BLOCKED;
+		}
+		if (verdict.status != ROUTE_VALID) {
+			verdict.failedAt = k;
+			return verdict;
+		}
+		cost += map.getCost(to);
+		standing = false;
+	}
+	verdict.cost = cost;
+	return verdict;
+}
+
+// Check routes first to last - 1 of batch, one thread's share of validateRoutes()
+static void validateBlock(const Map &map, const RouteBatch &batch, vector<RouteVerdict> &verdicts, int first, int last) {
+	for (int r = first; r < last; r++) {
+		uint32_t start = batch.offsets[r];
+		verdicts[r] = validateRoute(map, batch.x.data() + start, batch.y.data() + start, batch.offsets[r+1] - start);
+	}
+}
+
+// Check every route of batch on map, verdicts[r] is the verdict on route r
+// The routes are dealt out to threads (one per core if 0) in contiguous blocks of about the same number of
+// locations, and each thread writes only its own verdicts, so nothing is shared but the map
+void validateRoutes(const Map &map, const RouteBatch &batch, vector<RouteVerdict> &verdicts, int threads = 0) {
+
+	int routes = batch.size();
+	verdicts.resize(routes);
+	if (threads <= 0) {
+		threads = thread::hardware_concurrency();
+	}
+	threads = max(1, min(threads, routes));
+
+	// Block b starts at the first route starting at or after b/threads of the way through the locations
+	vector<int> first(threads + 1, routes);
+	for (int b = 0, r = 0; b < threads; b++) {
+		uint64_t target = (uint64_t)batch.x.size()*b/threads;
+		while (r < routes && batch.offsets[r] < target) {
+			r++;
+		}
+		first[b] = r;
+	}
+
+	// The calling thread takes the last block
+	vector<thread> pool;
+	for (int b = 0; b + 1 < threads; b++) {
+		pool.push_back(thread(validateBlock, cref(map), cref(batch), ref(verdicts), first[b], first[b+1]));
+	}
+	validateBlock(map, batch, verdicts, first[threads-1], first[threads]);
+	for (size_t t = 0; t < pool.size(); t++) {
+		pool[t].join();
+	}
+}
+
+// Cost fields found a whole cost layer at a time on bitboards, rather than one location at a time off an open list.
+// Each row of the map is a run of 64-bit words (bit x%64 of word x/64 is location x), in blocks of BLOCK_WORDS words,
+// one AVX2 register. Every location first reached at cost c is expanded at once: for each of the 8 moves the layer
+// is ANDed with the mask of locations that move is legal from (its moveMap bit, so it passes no 'B' and lands on
+// no 'R'), shifted by the move, and split by landing cost into the layers for c+1 up to c+maxCost, a ring of
+// layers like BucketQueue's buckets. Only the blocks with something in them are visited, from a list per layer.
+// Landings on portal entries are rare, so those are followed one location at a time.
+// The costs are exactly search()'s. Compiled with AVX2 (e.g. -mavx2) the blocks are worked on in registers,
+// otherwise word by word. The masks come from build(), which has to be called again after the map changes
+class BitFrontier {
+
+public:
+
+	static const int BLOCK_WORDS = 4; // Words per block
+	static const int BLOCK_BITS = 64*BLOCK_WORDS; // Locations per block
+
+	// The dirmap moves in pairs landing in the same row, the one right first
+	static const int rowMoves[4][2];
+
+	int width; // Width of the map built for
+	int height; // Height of the map built for
+	int blocksWide; // Blocks across each row
+	int reached; // Locations the last run() reached
+
+private:
+
+	const Map *source; // Map built for, for its portals
+	uint64_t sourceVersion; // Map::version of source the masks were made from
+	int rowWords; // Words across each row
+
+	// Legal Masks: bit set for each location the move dirmap[i] out of is legal, one mask per move
+	// Landing Masks: bit set for each location stood on after landing on it for landingCosts[c], one mask per cost.
+	// Portal entries are in none of them but in entries, and Landable has every landing mask's locations
+	vector<uint64_t> legal[8];
+	vector<int> landingCosts;
+	vector<vector<uint64_t> > landingMasks;
+	vector<uint64_t> landable;
+	vector<uint64_t> entries;
+	vector<uint8_t> entryBlocks; // 1 for each block with a portal entry in it
+
+	// Per run: the locations already reached, and the ring of layers of locations reached at each cost still to come,
+	// with the blocks listed (each once) that have something in them
+	vector<uint64_t> visited;
+	vector<vector<uint64_t> > layers;
+	vector<vector<int> > active;
+	vector<vector<uint8_t> > listed;
+	int pending; // Blocks listed across all the layers
+
+	// Take the locations of a layer's block not already reached into front, marking them reached and emptying
+	// the block. Returns false if there are none
+	static bool takeBlock(uint64_t *layer, uint64_t *seen, uint64_t *front) {
+#ifdef __AVX2__
+		__m256i found = _mm256_loadu_si256((const __m256i *)layer);
+		__m256i old = _mm256_loadu_si256((const __m256i *)seen);
+		found = _mm256_andnot_si256(old, found);
+		_mm256_storeu_si256((__m256i *)front, found);
+		_mm256_storeu_si256((__m256i *)seen, _mm256_or_si256(old, found));
+		_mm256_storeu_si256((__m256i *)layer, _mm256_setzero_si256());
+		return !_mm256_testz_si256(found, found);
+#else
+		uint64_t any = 0;
+		for (int w = 0; w < BLOCK_WORDS; w++) {
+			front[w] = layer[w] & ~seen[w];
+			seen[w] |= front[w];
+			layer[w] = 0;
+			any |= front[w];
+		}
+		return any != 0;
+#endif
+	}
+
+	// Move the locations of front the move legal is the mask of by dx across, adding them to to, in the same columns
+	// of the row the move lands in. The bits carried out of the block (into the next word right if dx > 0, left if not)
+	// are added to carry. Returns false if nothing moves
+	static bool moveBlock(const uint64_t *front, const uint64_t *legal, int dx, uint64_t *to, uint64_t &carry) {
+#ifdef __AVX2__
+		__m256i from = _mm256_and_si256(_mm256_loadu_si256((const __m256i *)front), _mm256_loadu_si256((const __m256i *)legal));
+		if (_mm256_testz_si256(from, from)) {
+			return false;
+		}
+		__m256i zero = _mm256_setzero_si256();
+		__m256i moved;
+
+		// Each word takes the bits shifted out of its neighbor by moving that one lane along, the end lane zeroed
+		if (dx > 0) {
+			__m256i lower = _mm256_blend_epi32(_mm256_permute4x64_epi64(from, 0x93), zero, 0x03);
+			moved = _mm256_or_si256(_mm256_sll_epi64(from, _mm_cvtsi32_si128(dx)),
+									_mm256_srl_epi64(lower, _mm_cvtsi32_si128(64 - dx)));
+			carry |= (front[BLOCK_WORDS-1] & legal[BLOCK_WORDS-1]) >> (64 - dx);
+		}
+		else {
+			__m256i upper = _mm256_blend_epi32(_mm256_permute4x64_epi64(from, 0x39), zero, 0xc0);
+			moved = _mm256_or_si256(_mm256_srl_epi64(from, _mm_cvtsi32_si128(-dx)),
+									_mm256_sll_epi64(upper, _mm_cvtsi32_si128(64 + dx)));
+			carry |= (front[0] & legal[0]) << (64 + dx);
+		}
+		_mm256_storeu_si256((__m256i *)to, _mm256_or_si256(_mm256_loadu_si256((const __m256i *)to), moved));
+		return true;
+#else
+		uint64_t from[BLOCK_WORDS];
+		uint64_t any = 0;
+		for (int w = 0; w < BLOCK_WORDS; w++) {
+			from[w] = front[w] & legal[w];
+			any |= from[w];
+		}
+		if (any == 0) {
+			return false;
+		}
+		if (dx > 0) {
+			for (int w = 0; w < BLOCK_WORDS; w++) {
+				to[w] |= from[w] << dx | (w > 0 ? from[w-1] >> (64 - dx) : 0);
+			}
+			carry |= from[BLOCK_WORDS-1] >> (64 - dx);
+		}
+		else {
+			for (int w = 0; w < BLOCK_WORDS; w++) {
+				to[w] |= from[w] >> -dx | (w + 1 < BLOCK_WORDS ? from[w+1] << (64 + dx) : 0);
+			}
+			carry |= from[0] << (64 + dx);
+		}
+		return true;
+#endif
+	}
+
+	// Add the locations of moved that are in mask and not already reached to a layer's block.
+	// Returns false if there are none
+	static bool addBlock(uint64_t *layer, const uint64_t *moved, const uint64_t *mask, const uint64_t *seen) {
+#ifdef __AVX2__
+		__m256i add = _mm256_and_si256(_mm256_loadu_si256((const __m256i *)moved), _mm256_loadu_si256((const __m256i *)mask));
+		add = _mm256_andnot_si256(_mm256_loadu_si256((const __m256i *)seen), add);
+		if (_mm256_testz_si256(add, add)) {
+			return false;
+		}
+		_mm256_storeu_si256((__m256i *)layer, _mm256_or_si256(_mm256_loadu_si256((const __m256i *)layer), add));
+		return true;
+#else
+		uint64_t any = 0;
+		for (int w = 0; w < BLOCK_WORDS; w++) {
+			uint64_t add = moved[w] & mask[w] & ~seen[w];
+			layer[w] |= add;
+			any |= add;
+		}
+		return any != 0;
+#endif
+	}
+
+	// Put a block on the list of layer q, unless it is already there
+	void list(int q, int block) {
+		if (!listed[q][block]) {
+			listed[q][block] = 1;
+			active[q].push_back(block);
+			pending++;
+		}
+	}
+
+	// Land the locations of moved, count words from word first, at cost plus the cost of each
+	void land(size_t first, const uint64_t *moved, int count, int cost, int ring, Objective objective) {
+
+		int block = first / BLOCK_WORDS;
+		int nclasses = (objective == FEWEST_MOVES) ? 1 : landingCosts.size();
+		for (int c = 0; c < nclasses; c++) {
+			const uint64_t *mask = (objective == FEWEST_MOVES) ? &landable[first] : &landingMasks[c][first];
+			int q = (cost + (objective == FEWEST_MOVES ? 1 : landingCosts[c])) % ring;
+			bool added;
+			if (count == BLOCK_WORDS) {
+				added = addBlock(&layers[q][first], moved, mask, &visited[first]);
+			}
+			else {
+				uint64_t add = moved[0] & mask[0] & ~visited[first];
+				layers[q][first] |= add;
+				added = (add != 0);
+			}
+			if (added) {
+				list(q, block);
+			}
+		}
+
+		// Landing on a portal entry puts us on its exit, for the entry's cost
+		for (int w = 0; w < count && entryBlocks[block]; w++) {
+			for (uint64_t portals = moved[w] & entries[first + w]; portals != 0; portals &= portals - 1) {
+				int y = (first + w) / rowWords;
+				int x = (first + w) % rowWords*64 + __builtin_ctzll(portals);
+				int exit = source->getPortalExit(y*width + x);
+				int q = (cost + (objective == FEWEST_MOVES ? 1 : source->getCost(y*width + x))) % ring;
+				size_t word = (size_t)(exit / width)*rowWords + exit % width / 64;
+				uint64_t bit = 1ull << (exit % width % 64);
+				if (!(visited[word] & bit)) {
+					layers[q][word] |= bit;
+					list(q, word / BLOCK_WORDS);
+				}
+			}
+		}
+	}
+
+public:
+
+	BitFrontier() {
+		width = 0;
+		height = 0;
+		blocksWide = 0;
+		reached = 0;
+		source = NULL;
+		sourceVersion = 0;
+		rowWords = 0;
+		pending = 0;
+	}
+
+	// Make the masks for map, which has to outlive the frontier (or the next build()).
+	// run() makes them again itself whenever it is given another map or the map has changed since (setChar())
+	void build(const Map &map) {
+
+		source = &map;
+		sourceVersion = map.version;
+		width = map.width;
+		height = map.height;
+		blocksWide = (width + BLOCK_BITS - 1) / BLOCK_BITS;
+		rowWords = blocksWide*BLOCK_WORDS;
+		size_t words = (size_t)height*rowWords;
+
+		for (int i = 0; i < 8; i++) {
+			legal[i].assign(words, 0);
+		}
+		landingCosts.clear();
+		landingMasks.clear();
+		landable.assign(words, 0);
+		entries.assign(words, 0);
+		entryBlocks.assign(height*blocksWide, 0);
+		visited.assign(words, 0);
+		layers.clear();
+		active.clear();
+		listed.clear();
+
+		for (int y = 0; y < height; y++) {
+			for (int x = 0; x < width; x++) {
+
+				int k = y*width + x;
+				size_t word = (size_t)y*rowWords + x/64;
+				uint64_t bit = 1ull << (x % 64);
+
+				for (unsigned int moves = map.getMoves(k); moves != 0; moves &= moves - 1) {
+					legal[__builtin_ctz(moves)][word] |= bit;
+				}
+
+				// Nothing lands on a 'B' or an 'R', the move table already rules those out
+				if (map.getPortal(k) >= 0) {
+					entries[word] |= bit;
+					entryBlocks[word / BLOCK_WORDS] = 1;
+				}
+				else if (map.getChar(k) != 'B' && map.getChar(k) != 'R') {
+					size_t c = find(landingCosts.begin(), landingCosts.end(), map.getCost(k)) - landingCosts.begin();
+					if (c == landingCosts.size()) {
+						landingCosts.push_back(map.getCost(k));
+						landingMasks.push_back(vector<uint64_t>(words, 0));
+					}
+					landingMasks[c][word] |= bit;
+					landable[word] |= bit;
+				}
+			}
+		}
+	}
+
+	// Cheapest cost from (startx, starty) to each location into costs, -1 where there is no route, by the objective's costs.
+	// Stops once (endx, endy) is reached, leaving costs beyond its cost at -1, unless that is (-1, -1).
+	// Returns the cost of reaching the end point, -1 if there is none (or no route to it)
+	int run(const Map &map, int startx, int starty, int endx, int endy, vector<int32_t> &costs,
+			Objective objective = CHEAPEST) {
+
+		if (source != &map || sourceVersion != map.version) {
+			build(map);
+		}
+		costs.assign(width*height, -1);
+		reached = 0;
+		if (startx < 0 || startx >= width || starty < 0 || starty >= height) {
+			return -1;
+		}
+		int end = (endx >= 0 && endx < width && endy >= 0 && endy < height) ? endy*width + endx : -1;
+
+		// Landing costs are below the ring's size, so no layer ever lands on itself
+		int ring = 2;
+		if (objective != FEWEST_MOVES) {
+			for (size_t c = 0; c < landingCosts.size(); c++) {
+				ring = max(ring, landingCosts[c] + 1);
+			}
+		}
+		size_t words = (size_t)height*rowWords;
+		if ((int)layers.size() < ring) {
+			layers.resize(ring, vector<uint64_t>(words, 0));
+			active.resize(ring);
+			listed.resize(ring, vector<uint8_t>(height*blocksWide, 0));
+		}
+		fill(visited.begin(), visited.end(), 0);
+
+		size_t word = (size_t)starty*rowWords + startx/64;
+		layers[0][word] |= 1ull << (startx % 64);
+		pending = 0;
+		list(0, word / BLOCK_WORDS);
+
+		int found = -1;
+		uint64_t front[BLOCK_WORDS];
+		uint64_t moved[BLOCK_WORDS];
+		for (int cost = 0; pending > 0 && found < 0; cost++) {
+
+			int q = cost % ring;
+			vector<int> &blocks = active[q];
+			for (size_t n = 0; n < blocks.size(); n++) {
+
+				int block = blocks[n];
+				listed[q][block] = 0;
+				size_t first = (size_t)block*BLOCK_WORDS;
+				if (!takeBlock(&layers[q][first], &visited[first], front)) {
+					continue;
+				}
+
+				// Everything in the block is reached at this cost
+				int y = block / blocksWide;
+				int x0 = block % blocksWide*BLOCK_BITS;
+				for (int w = 0; w < BLOCK_WORDS; w++) {
+					for (uint64_t bits = front[w]; bits != 0; bits &= bits - 1) {
+						int k = y*width + x0 + w*64 + __builtin_ctzll(bits);
+						costs[k] = cost;
+						reached++;
+						if (k == end) {
+							found = cost;
+						}
+					}
+				}
+
+				// Each move lands in the same columns dirmap[i][1] rows along, give or take the word carried into,
+				// so the two moves to each row (one right, one left) are landed together
+				for (int r = 0; r < 4; r++) {
+					int right = rowMoves[r][0];
+					int left = rowMoves[r][1];
+					int to = y + dirmap[right][1];
+					if (to < 0 || to >= height) {
+						continue;
+					}
+					uint64_t carryRight = 0;
+					uint64_t carryLeft = 0;
+					fill(moved, moved + BLOCK_WORDS, 0);
+					bool any = moveBlock(front, &legal[right][first], dirmap[right][0], moved, carryRight);
+					any = moveBlock(front, &legal[left][first], dirmap[left][0], moved, carryLeft) || any;
+					if (!any) {
+						continue;
+					}
+					size_t target = first + (ptrdiff_t)dirmap[right][1]*rowWords;
+					land(target, moved, BLOCK_WORDS, cost, ring, objective);
+					if (carryRight != 0) {
+						land(target + BLOCK_WORDS, &carryRight, 1, cost, ring, objective);
+					}
+					if (carryLeft != 0) {
+						land(target - 1, &carryLeft, 1, cost, ring, objective);
+					}
+				}
+			}
+			pending -= blocks.size();
+			blocks.clear();
+		}
+
+		// Empty whatever layers are left after stopping at the end point, for the next run
+		for (int q = 0; q < ring; q++) {
+			for (size_t n = 0; n < active[q].size(); n++) {
+				int block = active[q][n];
+				listed[q][block] = 0;
+				fill(layers[q].begin() + (size_t)block*BLOCK_WORDS, layers[q].begin() + (size_t)(block + 1)*BLOCK_WORDS, 0);
+			}
+			active[q].clear();
+		}
+		pending = 0;
+
+		return found;
+	}
+};
+
+const int BitFrontier::rowMoves[4][2] = {{0, 3}, {1, 2}, {7, 4}, {6, 5}};
+
+// Cost of the cheapest route from one start point to every location on a map
+// Built by running search() with no end point (or a BitFrontier, see buildLayers()), after which any
+// route out of the start can be read off the parent map without searching again
+class CostField {
+
+public:
+
+	int width; // Width of the map
+	int height; // Height of the map
+	int startx; // Start point every route begins at
+	int starty;
+
+	// Cost Map: Cost of the cheapest route to each location, -1 if it cannot be reached
+	// Parent Map: Index of the location before each one on its route (the start is its own parent)
+	vector<int32_t> costMap;
+	vector<uint32_t> parentMap;
+
+	CostField() {
+		width = 0;
+		height = 0;
+		startx = -1;
+		starty = -1;
+	}
+
+	// Work out the field for map from (sx, sy), using state as scratch space
+	void build(const Map &map, SearchState &state, int sx, int sy, Objective objective = CHEAPEST) {
+
+		width = map.width;
+		height = map.height;
+		startx = sx;
+		starty = sy;
+
+		search(map, state, sx, sy, -1, -1, false, objective);
+
+		costMap.resize(width*height);
+		parentMap.resize(width*height);
+		for (int k = 0; k < width*height; k++) {
+			if (state.isClosed(k)) {
+				costMap[k] = state.getCost(k);
+				parentMap[k] = state.getParent(k);
+			}
+			else {
+				costMap[k] = -1;
+				parentMap[k] = k;
+			}
+		}
+	}
+
+	// The same field found by frontier a whole cost layer at a time instead (see BitFrontier), with the same costs.
+	// Each parent is then worked out from the costs as a location the cost of the landing cheaper, which can be
+	// another of the cheapest routes than search() would have kept
+	void buildLayers(const Map &map, BitFrontier &frontier, int sx, int sy, Objective objective = CHEAPEST) {
+
+		width = map.width;
+		height = map.height;
+		startx = sx;
+		starty = sy;
+
+		frontier.run(map, sx, sy, -1, -1, costMap, objective);
+
+		parentMap.resize(width*height);
+		for (int k = 0; k < width*height; k++) {
+			parentMap[k] = k;
+			if (costMap[k] <= 0) {
+				continue;
+			}
+
+			// Landed on k itself, or on the entry of a portal leading to it, by a move into the landing point
+			bool done = false;
+			for (int landing = map.nextLanding(k, -1); landing >= 0 && !done; landing = map.nextLanding(k, landing)) {
+				int step = (objective == FEWEST_MOVES) ? 1 : map.getCost(landing);
+				for (unsigned int moves = map.getReverseMoves(landing); moves != 0 && !done; moves &= moves - 1) {
+					int i = __builtin_ctz(moves);
+					int from = landing - map.moveOffset[i];
+					if (costMap[from] >= 0 && costMap[from] + step == costMap[k]) {
+						parentMap[k] = (landing == k) ? from : portalParent(from, i);
+						done = true;
+					}
+				}
+			}
+		}
+	}
+
+	int getCost(int x, int y) const {return costMap[y*width + x];}
+	bool reachable(int x, int y) const {return getCost(x, y) >= 0;}
+
+	// The route from the start to (x, y), end first like tracePath()
+	// Returns false (and leaves path empty) if there is none
+	bool getPath(const Map &map, int x, int y, vector<Node> &path) const {
+		path.clear();
+		if (x < 0 || x >= width || y < 0 || y >= height || !reachable(x, y)) {
+			return false;
+		}
+		traceParents(map, &parentMap[0], startx, starty, x, y, path);
+		return true;
+	}
+
+	// Print the entire field of route costs, one row per line, '.' where there is no route
+	// Each cost is padded to the width of the largest
+	void printCostField() const {
+
+		int most = 0;
+		for (int k = 0; k < width*height; k++) {
+			most = max(most, (int)costMap[k]);
+		}
+		int digits = 1;
+		for (int m = most; m >= 10; m /= 10) {
+			digits++;
+		}
+
+		string row;
+		for (int j = 0; j < height; j++) {
+			row.clear();
+			for (int i = 0; i < width; i++) {
+				string cell = reachable(i, j) ? to_string(getCost(i, j)) : ".";
+				if (i > 0) {
+					row += ' ';
+				}
+				row.append(digits - cell.size(), ' ');
+				row += cell;
+			}
+			cout << row << '\n';
+		}
+	}
+
+	// Print the entire field of parents, one character per location:
+	// the dirmap index (0-7) of the move that reached it, 'T' if it was reached through a portal,
+	// 'S' for the start and '.' where there is no route
+	void printParentField() const {
+		for (int j = 0; j < height; j++) {
+			for (int i = 0; i < width; i++) {
+				int k = j*width + i;
+				char c = '.';
+				if (i == startx && j == starty) {
+					c = 'S';
+				}
+				else if (reachable(i, j) && (parentMap[k] & VIA_PORTAL)) {
+					c = 'T';
+				}
+				else if (reachable(i, j)) {
+					int dx = i - (int)parentMap[k] % width;
+					int dy = j - (int)parentMap[k] / width;
+					for (int d = 0; d < 8; d++) {
+						if (dirmap[d][0] == dx && dirmap[d][1] == dy) {
+							c = '0' + d;
+						}
+					}
+				}
+				cout << c;
+			}
+			cout << '\n';
+		}
+	}
+};
+
+// Hierarchical search (HPA*): the board is cut into square clusters, and a few of the knight moves out of
+// each cluster into its neighbors are kept as crossings. The locations the crossings leave from and end up on
+// are the nodes of a much smaller abstract graph, whose edges are the crossings and the cheapest routes
+// between the nodes of one cluster that stay inside it, all worked out ahead of time.
+// A query links its end points to the nodes of their clusters, searches the abstract graph, and then refines
+// the route with a search through just the clusters it passes through. Since only some crossings are kept, a route can come out
+// a little dearer than search()'s, and if the abstract graph has no route at all the query falls back to search().
+// Costs follow the CHEAPEST objective. Queries use scratch space in the hierarchy, so run one at a time
+class Hierarchy {
+
+private:
+
+	// A knight move out of a cluster: standing on from, landing on land and ending up on to
+	// (land and to only differ when land is a portal entry)
+	struct Crossing {
+		int from;
+		int land;
+		int to;
+	};
+
+	struct Cluster {
+		vector<Crossing> exits; // Crossings kept out of the cluster
+		vector<int> nodes; // Locations in the cluster that are nodes of the abstract graph
+		vector<int32_t> dist; // dist[a*n + b]: cheapest route inside the cluster from node a to node b, -1 if none
+	};
+
+	int size; // Width and height of a cluster in locations
+	int cols; // Clusters across the board
+	int rows; // Clusters down the board
+	int width; // Width of the map
+	int height; // Height of the map
+	int portalVersion; // Map::portalVersion when built, the hierarchy is rebuilt if the portals change
+
+	vector<Cluster> clusters; // Row-major like the board
+	vector<int> nodeOf; // Per location: index in its cluster's nodes, -1 if it is not a node
+	vector<uint8_t> entryCount; // Per location: number of kept crossings that end up on it
+
+	// Scratch space for searches inside one cluster, by local index (row-major within the cluster)
+	vector<uint32_t> localStamp;
+	vector<int32_t> localCost;
+	vector<int> localParent;
+	uint32_t localGeneration;
+	BucketQueue localOpen;
+
+	// Scratch space for queries: costs from the start to the nodes of its cluster,
+	// and from the nodes of the end's cluster to the end
+	vector<int> startCost;
+	vector<int> endCost;
+
+	// Per cluster: whether it is on the current query's route, when its stamp is corridorStamp
+	vector<uint32_t> corridor;
+	uint32_t corridorStamp;
+
+	int clusterOf(int k) const {return ((k / width) / size)*cols + (k % width) / size;}
+	int localIndex(int k) const {return ((k / width) % size)*size + (k % width) % size;}
+
+	// Cost of the last clusterSearch() to location k (which must be in the cluster searched), -1 if unreached
+	int localCostOf(int k) const {
+		int l = localIndex(k);
+		return localStamp[l] == localGeneration + 1 ? localCost[l] : -1;
+	}
+
+	// Uniform-cost search from location from that never leaves its cluster.
+	// Forward it follows the moves out of each location, and the local parent is the location before.
+	// Backward it follows the moves into each location (see searchBidirectional()), its costs are to from,
+	// and the local parent is the location after
+	void clusterSearch(const Map &map, int from, bool backward) {
+
+		int c = clusterOf(from);
+		int x0 = (c % cols)*size;
+		int y0 = (c / cols)*size;
+
+		localGeneration += 2;
+		if (localGeneration == 0) {
+			fill(localStamp.begin(), localStamp.end(), 0);
+			localGeneration = 2;
+		}
+		localOpen.reset(size*size, map.maxCost);
+
+		int l = localIndex(from);
+		localStamp[l] = localGeneration;
+		localCost[l] = 0;
+		localParent[l] = from;
+		localOpen.push(l, 0);
+
+		while (!localOpen.empty()) {
+
+			l = localOpen.pop();
+			localStamp[l] = localGeneration + 1;
+			int idx = (y0 + l / size)*width + x0 + l % size;
+			int cost = localCost[l];
+
+			// A legal move stays on the board, so it stays in the cluster if it stays inside the cluster's square,
+			// which only needs the local coordinates unless a portal moves it elsewhere
+			if (!backward) {
+				for (unsigned int moves = map.getMoves(idx); moves != 0; moves &= moves - 1) {
+					int i = __builtin_ctz(moves);
+					int land = idx + map.moveOffset[i];
+					int to = map.getPortalExit(land);
+					if (to >= 0) {
+						if (clusterOf(to) == c) {
+							relaxLocal(localIndex(to), idx, cost + map.getCost(land));
+						}
+						continue;
+					}
+					int lx = l % size + dirmap[i][0];
+					int ly = l / size + dirmap[i][1];
+					if (lx >= 0 && lx < size && ly >= 0 && ly < size) {
+						relaxLocal(ly*size + lx, idx, cost + map.getCost(land));
+					}
+				}
+			}
+			else {
+				for (int landing = map.nextLanding(idx, -1); landing >= 0; landing = map.nextLanding(idx, landing)) {
+					if (landing != idx) {
+						for (unsigned int moves = map.getReverseMoves(landing); moves != 0; moves &= moves - 1) {
+							int prev = landing - map.moveOffset[__builtin_ctz(moves)];
+							if (clusterOf(prev) == c) {
+								relaxLocal(localIndex(prev), idx, cost + map.getCost(landing));
+							}
+						}
+						continue;
+					}
+					for (unsigned int moves = map.getReverseMoves(idx); moves != 0; moves &= moves - 1) {
+						int i = __builtin_ctz(moves);
+						int lx = l % size - dirmap[i][0];
+						int ly = l / size - dirmap[i][1];
+						if (lx >= 0 && lx < size && ly >= 0 && ly < size) {
+							relaxLocal(ly*size + lx, idx, cost + map.getCost(idx));
+						}
+					}
+				}
+			}
+		}
+	}
+
+	void relaxLocal(int l, int parent, int cost) {
+		if (localStamp[l] == localGeneration + 1 || (localStamp[l] == localGeneration && localCost[l] <= cost)) {
+			return;
+		}
+		if (localStamp[l] == localGeneration) {
+			localOpen.decrease(l, cost);
+		}
+		else {
+			localOpen.push(l, cost);
+			localStamp[l] = localGeneration;
+		}
+		localCost[l] = cost;
+		localParent[l] = parent;
+	}
+
+	// Pick the crossings kept out of cluster c: every move onto a portal entry, and otherwise only moves into a
+	// neighbor that leave from at least a quarter of a cluster away from the ones kept into it already
+	void selectExits(const Map &map, int c) {
+
+		Cluster &cl = clusters[c];
+		for (size_t e = 0; e < cl.exits.size(); e++) {
+			entryCount[cl.exits[e].to]--;
+		}
+		cl.exits.clear();
+
+		int spacing = max(2, size/2);
+		int x0 = (c % cols)*size;
+		int y0 = (c / cols)*size;
+
+		for (int j = y0; j < min(y0 + size, height); j++) {
+			for (int i = x0; i < min(x0 + size, width); i++) {
+
+				int idx = j*width + i;
+				for (unsigned int moves = map.getMoves(idx); moves != 0; moves &= moves - 1) {
+
+					Crossing crossing;
+					crossing.from = idx;
+					crossing.land = idx + map.moveOffset[__builtin_ctz(moves)];
+					crossing.to = map.getPortalExit(crossing.land);
+					bool keep = crossing.to >= 0;
+					if (!keep) {
+						crossing.to = crossing.land;
+					}
+					int d = clusterOf(crossing.to);
+					if (d == c) {
+						continue;
+					}
+
+					if (!keep) {
+						keep = true;
+						for (size_t e = 0; e < cl.exits.size() && keep; e++) {
+							int from = cl.exits[e].from;
+							if (clusterOf(cl.exits[e].to) == d &&
+								max(abs(from % width - i), abs(from / width - j)) < spacing) {
+								keep = false;
+							}
+						}
+					}
+					if (keep) {
+						cl.exits.push_back(crossing);
+						entryCount[crossing.to]++;
+					}
+				}
+			}
+		}
+	}
+
+	// Redo the nodes of cluster c (where its crossings leave from and others end up) and the routes between them
+	void updateNodes(const Map &map, int c) {
+
+		Cluster &cl = clusters[c];
+		for (size_t a = 0; a < cl.nodes.size(); a++) {
+			nodeOf[cl.nodes[a]] = -1;
+		}
+		cl.nodes.clear();
+
+		// Mark where the crossings leave from, then take every marked location or one a crossing ends up on
+		for (size_t e = 0; e < cl.exits.size(); e++) {
+			nodeOf[cl.exits[e].from] = -2;
+		}
+		int x0 = (c % cols)*size;
+		int y0 = (c / cols)*size;
+		for (int j = y0; j < min(y0 + size, height); j++) {
+			for (int i = x0; i < min(x0 + size, width); i++) {
+				int idx = j*width + i;
+				if (nodeOf[idx] == -2 || entryCount[idx] > 0) {
+					nodeOf[idx] = cl.nodes.size();
+					cl.nodes.push_back(idx);
+				}
+			}
+		}
+
+		int n = cl.nodes.size();
+		cl.dist.assign(n*n, -1);
+		for (int a = 0; a < n; a++) {
+			clusterSearch(map, cl.nodes[a], false);
+			for (int b = 0; b < n; b++) {
+				cl.dist[a*n + b] = localCostOf(cl.nodes[b]);
+			}
+		}
+	}
+
+	// A* search from start to end like search(), that only ends up on locations in the marked corridor clusters
+	// The end must be reachable through the corridor
+	void corridorSearch(const Map &map, SearchState &state, int start, int end) {
+
+		int endx = end % width;
+		int endy = end / width;
+		// Without the estimate if it can grow by more than the open list can span, as in search()
+		int scale = map.minCost;
+		if (map.maxCost + scale*state.estimate.getGrowth() > BucketQueue::MAX_SPAN) {
+			scale = 0;
+		}
+		state.reset(map, start % width, start / width, map.maxCost + scale*state.estimate.getGrowth());
+		state.setParent(start, start);
+		state.setCost(start, 0);
+		state.addToOpen(start);
+		state.openList.push(start, scale*state.estimate.moves(start % width, start / width));
+
+		while (!state.openList.empty()) {
+
+			int idx = state.openList.pop();
+			int cost = state.getCost(idx);
+			state.addToClosed(idx);
+			if (idx == end) {
+				state.setFinal(endx, endy, cost);
+				return;
+			}
+
+			for (unsigned int moves = map.getMoves(idx); moves != 0; moves &= moves - 1) {
+
+				int i = __builtin_ctz(moves);
+				int land = idx + map.moveOffset[i];
+				int next = map.getPortalExit(land);
+				uint32_t parent = idx;
+				if (next < 0) {
+					next = land;
+				}
+				else {
+					parent = portalParent(idx, i);
+				}
+				int elecost = cost + map.getCost(land);
+				if (corridor[clusterOf(next)] != corridorStamp || state.isClosed(next) ||
+					(state.isOpen(next) && state.getCost(next) <= elecost)) {
+					continue;
+				}
+
+				int priority = elecost + scale*state.estimate.moves(next % width, next / width);
+				if (state.isOpen(next)) {
+					state.openList.decrease(next, priority);
+				}
+				else {
+					state.openList.push(next, priority);
+					state.addToOpen(next);
+				}
+				state.setCost(next, elecost);
+				state.setParent(next, parent);
+			}
+		}
+	}
+
+	// Add a route to location v through location k of the abstract graph to the open list if it is the cheapest yet
+	static void relaxAbstract(const Map &map, SearchState &state,
+							  priority_queue<pair<int,int>, vector<pair<int,int> >, greater<pair<int,int> > > &open,
+							  int k, int v, int cost) {
+		if (state.isClosed(v) || (state.isOpen(v) && state.getCost(v) <= cost)) {
+			return;
+		}
+		state.addToOpen(v);
+		state.setCost(v, cost);
+		state.setParent(v, k);
+		open.push(make_pair(cost + map.minCost*state.estimate.moves(v % map.width, v / map.width), v));
+	}
+
+public:
+
+	int expanded; // Abstract nodes expanded by the last query
+	bool fellBack; // Whether the last query had to fall back to search()
+
+	Hierarchy() {
+		size = 0;
+		cols = 0;
+		rows = 0;
+		width = 0;
+		height = 0;
+		portalVersion = -1;
+		localGeneration = 0;
+		corridorStamp = 0;
+		expanded = 0;
+		fellBack = false;
+	}
+
+	int getClusterSize() const {return size;}
+	int getClusters() const {return clusters.size();}
+
+	// Number of nodes in the abstract graph
+	int getNodes() const {
+		int n = 0;
+		for (size_t c = 0; c < clusters.size(); c++) {
+			n += clusters[c].nodes.size();
+		}
+		return n;
+	}
+
+	// Cut map into clusters of clusterSize x clusterSize locations (at least 4, so that a knight move
+	// only ever reaches the next cluster over) and work out every cluster's crossings and routes
+	void build(const Map &map, int clusterSize = 16) {
+
+		size = max(clusterSize, 4);
+		width = map.width;
+		height = map.height;
+		cols = (width + size - 1) / size;
+		rows = (height + size - 1) / size;
+		portalVersion = map.portalVersion;
+
+		clusters.assign(cols*rows, Cluster());
+		nodeOf.assign(width*height, -1);
+		entryCount.assign(width*height, 0);
+		localStamp.assign(size*size, 0);
+		localCost.resize(size*size);
+		localParent.resize(size*size);
+		localGeneration = 0;
+		corridor.assign(cols*rows, 0);
+		corridorStamp = 0;
+
+		for (int c = 0; c < cols*rows; c++) {
+			selectExits(map, c);
+		}
+		for (int c = 0; c < cols*rows; c++) {
+			updateNodes(map, c);
+		}
+	}
+
+	// Bring the hierarchy up to date after map.setChar(x, y, ...)
+	// Only the moves out of the 5x5 square around (x, y) change, so only the clusters that square overlaps
+	// pick their crossings again, and only those and the clusters their crossings end up in are redone.
+	// A change to the portals can reroute moves anywhere on the board, so that rebuilds everything
+	void cellChanged(const Map &map, int x, int y) {
+
+		if (map.portalVersion != portalVersion) {
+			build(map, size);
+			return;
+		}
+
+		vector<int> dirty;
+		for (int cy = max(y-2, 0) / size; cy <= min(y+2, height-1) / size; cy++) {
+			for (int cx = max(x-2, 0) / size; cx <= min(x+2, width-1) / size; cx++) {
+
+				int c = cy*cols + cx;
+				dirty.push_back(c);
+				for (size_t e = 0; e < clusters[c].exits.size(); e++) {
+					dirty.push_back(clusterOf(clusters[c].exits[e].to));
+				}
+				selectExits(map, c);
+				for (size_t e = 0; e < clusters[c].exits.size(); e++) {
+					dirty.push_back(clusterOf(clusters[c].exits[e].to));
+				}
+			}
+		}
+
+		sort(dirty.begin(), dirty.end());
+		dirty.erase(unique(dirty.begin(), dirty.end()), dirty.end());
+		for (size_t d = 0; d < dirty.size(); d++) {
+			updateNodes(map, dirty[d]);
+		}
+	}
+
+	// Route from (startx, starty) to (endx, endy) through the hierarchy, using state as scratch space
+	// Fills total_path with the locations from the end back to the start like tracePath(), and leaves
+	// the cost as state's final cost. Returns false (and leaves total_path empty) if there is no route
+	bool query(const Map &map, SearchState &state, int startx, int starty, int endx, int endy,
+			   vector<Node> &total_path) {
+
+		expanded = 0;
+		fellBack = false;
+		total_path.clear();
+		state.estimate.reset(map, endx, endy);
+		state.reset(map, startx, starty, 1);
+
+		if (startx < 0 || startx >= width || starty < 0 || starty >= height ||
+			endx < 0 || endx >= width || endy < 0 || endy >= height) {
+			return false;
+		}
+
+		int start = starty*width + startx;
+		int end = endy*width + endx;
+		const Cluster &first = clusters[clusterOf(start)];
+		const Cluster &last = clusters[clusterOf(end)];
+
+		// Link the start and end into the abstract graph through their clusters
+		clusterSearch(map, start, false);
+		startCost.resize(first.nodes.size());
+		for (size_t a = 0; a < first.nodes.size(); a++) {
+			startCost[a] = localCostOf(first.nodes[a]);
+		}
+		int direct = (&first == &last) ? localCostOf(end) : -1;
+
+		clusterSearch(map, end, true);
+		endCost.resize(last.nodes.size());
+		for (size_t a = 0; a < last.nodes.size(); a++) {
+			endCost[a] = localCostOf(last.nodes[a]);
+		}
+
+		// A* over the abstract graph, ordered by cost plus the estimate with stale entries skipped
+		priority_queue<pair<int,int>, vector<pair<int,int> >, greater<pair<int,int> > > open;
+		state.setCost(start, 0);
+		state.setParent(start, start);
+		state.addToOpen(start);
+		open.push(make_pair(map.minCost*state.estimate.moves(startx, starty), start));
+
+		bool found = false;
+		while (!open.empty()) {
+
+			int k = open.top().second;
+			open.pop();
+			if (state.isClosed(k)) {
+				continue;
+			}
+			state.addToClosed(k);
+			expanded++;
+
+			if (k == end) {
+				found = true;
+				break;
+			}
+
+			int cost = state.getCost(k);
+			if (k == start) {
+				for (size_t a = 0; a < first.nodes.size(); a++) {
+					if (startCost[a] >= 0) {
+						relaxAbstract(map, state, open, k, first.nodes[a], cost + startCost[a]);
+					}
+				}
+				if (direct >= 0) {
+					relaxAbstract(map, state, open, k, end, cost + direct);
+				}
+			}
+
+			if (nodeOf[k] >= 0) {
+				const Cluster &cl = clusters[clusterOf(k)];
+				int a = nodeOf[k];
+				int n = cl.nodes.size();
+				for (int b = 0; b < n; b++) {
+					if (cl.dist[a*n + b] > 0) {
+						relaxAbstract(map, state, open, k, cl.nodes[b], cost + cl.dist[a*n + b]);
+					}
+				}
+				for (size_t e = 0; e < cl.exits.size(); e++) {
+					if (cl.exits[e].from == k) {
+						relaxAbstract(map, state, open, k, cl.exits[e].to, cost + map.getCost(cl.exits[e].land));
+					}
+				}
+				if (&cl == &last && endCost[a] >= 0) {
+					relaxAbstract(map, state, open, k, end, cost + endCost[a]);
+				}
+			}
+		}
+
+		if (!found) {
+			fellBack = true;
+			if (!search(map, state, startx, starty, endx, endy)) {
+				return false;
+			}
+			tracePath(map, state, total_path);
+			return true;
+		}
+
+		// The abstract route, start first
+		vector<int> route;
+		for (int k = end; k != start; k = state.getParent(k)) {
+			route.push_back(k);
+		}
+		route.push_back(start);
+		reverse(route.begin(), route.end());
+
+		// Refine the route with an A* search through only the clusters the abstract route passes through.
+		// The abstract route is itself a way through them, so the route found is never dearer and is usually
+		// the cheapest there is, while the search stays off the rest of the board
+		corridorStamp++;
+		if (corridorStamp == 0) {
+			fill(corridor.begin(), corridor.end(), 0);
+			corridorStamp = 1;
+		}
+		for (int k = end; ; k = state.getParent(k)) {
+			int c = clusterOf(k);
+			for (int cy = max(c / cols - 1, 0); cy <= min(c / cols + 1, rows - 1); cy++) {
+				for (int cx = max(c % cols - 1, 0); cx <= min(c % cols + 1, cols - 1); cx++) {
+					corridor[cy*cols + cx] = corridorStamp;
+				}
+			}
+			if (k == start) {
+				break;
+			}
+		}
+
+		corridorSearch(map, state, start, end);
+		tracePath(map, state, total_path);
+		return true;
+	}
+};
+
+// Incremental planner (LPA*) for one start and end on a map that changes through Map::setChar
+// Every location keeps g, the cost it was last expanded with, and rhs, the cheapest cost its predecessors'
+// g offer. A location where they differ is inconsistent and sits on the open list, ordered by
+// [min(g, rhs) + heuristic, min(g, rhs)]. After a change only the locations whose moves in changed are
+// looked at again, and the repairs spread from there only as far as costs actually change, so a few changes
+// near the route cost a small fraction of a new search(). Costs follow the CHEAPEST objective
+class Replanner {
+
+private:
+
+	static const int32_t INF = 0x3fffffff; // Cost of a location with no route (yet)
+
+	int start; // Location routes start from
+	int end; // Location routes end at
+	int width; // Width of the map
+	int height; // Height of the map
+	int minCost; // The heuristic scale the keys were worked out with
+	int portalVersion; // Map::portalVersion when planned
+	Heuristic estimate; // Estimate of the moves left to the end
+
+	vector<int32_t> g; // Per location: cost when last expanded
+	vector<int32_t> rhs; // Per location: cheapest cost through a predecessor
+	vector<int64_t> key; // Per location: open list key, while on it
+	vector<int> heapPos; // Per location: index in heap, -1 if not on the open list
+	vector<int> heap; // Binary heap of locations, lowest key first
+
+	int64_t calcKey(int k) const {
+		int64_t m = min(g[k], rhs[k]);
+		return ((m + (int64_t)minCost*estimate.moves(k % width, k / width)) << 32) | m;
+	}
+
+	void heapSwap(int a, int b) {
+		swap(heap[a], heap[b]);
+		heapPos[heap[a]] = a;
+		heapPos[heap[b]] = b;
+	}
+
+	void siftUp(int p) {
+		while (p > 0 && key[heap[(p-1)/2]] > key[heap[p]]) {
+			heapSwap(p, (p-1)/2);
+			p = (p-1)/2;
+		}
+	}
+
+	void siftDown(int p) {
+		int n = heap.size();
+		while (true) {
+			int least = p;
+			if (2*p+1 < n && key[heap[2*p+1]] < key[heap[least]]) {
+				least = 2*p+1;
+			}
+			if (2*p+2 < n && key[heap[2*p+2]] < key[heap[least]]) {
+				least = 2*p+2;
+			}
+			if (least == p) {
+				return;
+			}
+			heapSwap(p, least);
+			p = least;
+		}
+	}
+
+	void heapRemove(int k) {
+		int p = heapPos[k];
+		heapSwap(p, heap.size() - 1);
+		heap.pop_back();
+		heapPos[k] = -1;
+		if (p < (int)heap.size()) {
+			siftUp(p);
+			siftDown(p);
+		}
+	}
+
+	// Put location k on the open list with a fresh key if it is inconsistent, otherwise take it off
+	void updateOpen(int k) {
+		if (g[k] != rhs[k]) {
+			key[k] = calcKey(k);
+			if (heapPos[k] < 0) {
+				heapPos[k] = heap.size();
+				heap.push_back(k);
+			}
+			siftUp(heapPos[k]);
+			siftDown(heapPos[k]);
+		}
+		else if (heapPos[k] >= 0) {
+			heapRemove(k);
+		}
+	}
+
+	// Work rhs of location k out again from all of its predecessors, the same moves searchBidirectional()
+	// steps back through
+	void updateVertex(const Map &map, int k) {
+		if (k != start) {
+			int best = INF;
+			for (int landing = map.nextLanding(k, -1); landing >= 0; landing = map.nextLanding(k, landing)) {
+				for (unsigned int moves = map.getReverseMoves(landing); moves != 0; moves &= moves - 1) {
+					int prev = landing - map.moveOffset[__builtin_ctz(moves)];
+					if (g[prev] < INF) {
+						best = min(best, g[prev] + map.getCost(landing));
+					}
+				}
+			}
+			rhs[k] = best;
+		}
+		updateOpen(k);
+	}
+
+public:
+
+	int expanded; // Locations expanded by the last call to replan()
+
+	Replanner() {
+		start = -1;
+		end = -1;
+		width = 0;
+		height = 0;
+		minCost = 1;
+		portalVersion = -1;
+		expanded = 0;
+	}
+
+	// Start planning routes on map from (startx, starty) to (endx, endy), forgetting anything planned before
+	// Both points must be on the map
+	void plan(const Map &map, int startx, int starty, int endx, int endy) {
+
+		width = map.width;
+		height = map.height;
+		start = starty*width + startx;
+		end = endy*width + endx;
+		minCost = map.minCost;
+		portalVersion = map.portalVersion;
+		estimate.reset(map, endx, endy);
+
+		g.assign(width*height, INF);
+		rhs.assign(width*height, INF);
+		key.resize(width*height);
+		heapPos.assign(width*height, -1);
+		heap.clear();
+
+		rhs[start] = 0;
+		updateOpen(start);
+	}
+
+	// Bring the plan up to date after map.setChar(x, y, ...), call replan() for the new route
+	// Only moves out of the 5x5 square around (x, y) changed (see Map::setChar), and those land in the 9x9 square,
+	// so only the locations there have predecessors to look at again. A change to the portals or the
+	// heuristic's scale changes moves or keys all over the board, so those start the plan over
+	void cellChanged(const Map &map, int x, int y) {
+
+		if (map.portalVersion != portalVersion || map.minCost != minCost) {
+			plan(map, start % width, start / width, end % width, end / width);
+			return;
+		}
+
+		for (int j = max(y-4, 0); j <= min(y+4, height-1); j++) {
+			for (int i = max(x-4, 0); i <= min(x+4, width-1); i++) {
+				updateVertex(map, j*width + i);
+
+				// Moves onto a portal entry in the square end up on its exit
+				int exit = map.getPortalExit(j*width + i);
+				if (exit >= 0) {
+					updateVertex(map, exit);
+				}
+			}
+		}
+	}
+
+	// Expand inconsistent locations until the end's cost is settled
+	// Returns true if there is a route from the start to the end
+	bool replan(const Map &map) {
+
+		expanded = 0;
+		while (!heap.empty() && (key[heap[0]] < calcKey(end) || rhs[end] != g[end])) {
+
+			int k = heap[0];
+			heapRemove(k);
+			expanded++;
+
+			// A location now cheaper than it was passes the saving on to where it moves to.
+			// One that got dearer drops its cost entirely, and everything it moves to looks for a new way in
+			bool cheaper = g[k] > rhs[k];
+			if (cheaper) {
+				g[k] = rhs[k];
+			}
+			else {
+				g[k] = INF;
+				updateVertex(map, k);
+			}
+
+			for (unsigned int moves = map.getMoves(k); moves != 0; moves &= moves - 1) {
+				int land = k + map.moveOffset[__builtin_ctz(moves)];
+				int next = map.getPortalExit(land);
+				if (next < 0) {
+					next = land;
+				}
+				if (cheaper) {
+					if (next != start && g[k] + map.getCost(land) < rhs[next]) {
+						rhs[next] = g[k] + map.getCost(land);
+						updateOpen(next);
+					}
+				}
+				else {
+					updateVertex(map, next);
+				}
+			}
+		}
+
+		return rhs[end] < INF;
+	}
+
+	int getCost() const {return rhs[end];}
+
+	// The route from the start to the end planned by the last replan(), end first like tracePath()
+	// Steps back from each location to the predecessor its cost came through
+	// Returns false (and leaves total_path empty) if there is none
+	bool getPath(const Map &map, vector<Node> &total_path) const {
+
+		total_path.clear();
+		if (rhs[end] >= INF) {
+			return false;
+		}
+
+		int k = end;
+		total_path.push_back(Node(k % width, k / width));
+		while (k != start) {
+
+			int best = INF;
+			int parent = -1;
+			int through = -1;
+			for (int landing = map.nextLanding(k, -1); landing >= 0; landing = map.nextLanding(k, landing)) {
+				for (unsigned int moves = map.getReverseMoves(landing); moves != 0; moves &= moves - 1) {
+					int prev = landing - map.moveOffset[__builtin_ctz(moves)];
+					if (g[prev] < INF && g[prev] + map.getCost(landing) < best) {
+						best = g[prev] + map.getCost(landing);
+						parent = prev;
+						through = landing;
+					}
+				}
+			}
+			if (through != k) {
+				total_path.push_back(Node(through % width, through / width));
+			}
+			k = parent;
+			total_path.push_back(Node(k % width, k / width));
+		}
+		return true;
+	}
+};
+
+const int32_t Replanner::INF;
+
+// Level 5: the longest route from a start to an end that never visits the same location twice
+// (going through a portal visits both its entry and its exit). What counts as long is the cost of the route, or its number of
+// moves with FEWEST_MOVES. This is a depth-first search over every simple route, kept in check by:
+//  - The visited locations as a bitset, and a Zobrist hash of them that changes by one xor per move
+//  - Memoization: reaching the same location with the same visited set a second time for no more than before
+//    can not lead anywhere new, so a table of the best length seen per hash cuts those branches
+//  - An upper bound: the route can at most land once more on every unvisited location it can still pass through
+//    on its way to the end (see bound()), which ends branches that can not beat the best route, or reach the end at all
+//  - Moves to the locations with the fewest onward moves first (Warnsdorff's rule), to find long routes early
+// The routes out of the start are split into branches a few moves deep, and the threads take branches
+// until none are left, sharing the best length found so far for the bound.
+// Most boards up to about 12x12 finish and the answer is exact. Bigger (or very open) boards stop when the
+// time budget runs out, with the best route found by then
+class LongestPath {
+
+private:
+
+	// A location on the path of the search for blocks, and the next of its neighbors to try
+	struct Frame {
+		int v;
+		int next; // See blockNeighbor()
+		int arrival; // Next portal leading to v to try, once next is past the moves
+	};
+
+	// Per thread search data
+	struct Worker {
+		vector<uint64_t> visited; // Bit per location
+		vector<uint32_t> floodStamp; // Per location: stamped when the flood fill of the bound looks at it
+		vector<uint32_t> reachStamp; // Per location: stamped when the flood fill finds a route could use it,
+									 // and one more if the end can be reached from it too
+		uint32_t floodGeneration;
+		vector<int> floodStack;
+		vector<int> landed; // Portal entries the flood back from the end landed on
+
+		// Search for the blocks of the bound, see markBlocks()
+		vector<uint32_t> blockStamp; // Per location: stamped when the search finds it
+		vector<int> disc; // Per location: order the search found it in
+		vector<int> low; // Per location: earliest found location reachable from below it by one back edge
+		vector<char> hasEnd; // Per location: whether the end is below it
+		vector<int> blockStack; // Locations of the blocks not finished yet
+		vector<Frame> frames; // The search's path
+		vector<int> blockList; // Locations of the blocks between k and the end
+		vector<int> route; // Locations moved through since the start, start first
+		vector<uint64_t> memoKey; // Hash table of visited sets seen, by Zobrist hash
+		vector<int32_t> memoLength; // Longest route so far seen with each
+		long long nodes; // Routes extended
+	};
+
+	const Map *map;
+	Objective objective;
+	int start;
+	int end;
+	int threads;
+	chrono::steady_clock::time_point deadline;
+
+	vector<uint64_t> zobrist; // Per location: random key for it being visited
+	vector<uint64_t> zobristAt; // Per location: random key for standing on it
+
+	// Best route so far, shared between the threads
+	atomic<int> best;
+	atomic<bool> timedOut;
+	mutex bestLock;
+	vector<int> bestRoute;
+
+	// A route out of the start for a thread to carry on from
+	struct Branch {
+		vector<int> route; // Locations moved through, start first
+		int length;
+		uint64_t hash; // Zobrist hash of the locations in route
+	};
+
+	// Branches of the search for the threads to take
+	vector<Branch> branches;
+	atomic<int> nextBranch;
+
+	static const int MEMO_BITS = 20; // Memo table of 2^20 entries per thread
+
+	bool isVisited(const Worker &w, int k) const {return (w.visited[k >> 6] >> (k & 63)) & 1;}
+	void flip(Worker &w, int k) const {w.visited[k >> 6] ^= (uint64_t)1 << (k & 63);}
+
+	int gain(int land) const {return objective == FEWEST_MOVES ? 1 : map->getCost(land);}
+
+	// Where a move landing on land ends up (its portal exit, if it has one), -1 if that is visited
+	int landing(const Worker &w, int land) const {
+		if (isVisited(w, land)) {
+			return -1;
+		}
+		int to = map->getPortalExit(land);
+		if (to < 0) {
+			return land;
+		}
+		return isVisited(w, to) ? -1 : to;
+	}
+
+	// Whether a route standing on k could pass through location v (not a portal entry): it needs a way in from k
+	// or an unvisited location, and a way out to a different unvisited location. Any other location can only
+	// be where a route ends, so unless it is the end it is no use. A portal leading to v counts as a way in
+	// from anywhere
+	bool passable(const Worker &w, int k, int v) const {
+
+		int in = map->getFirstArrival(v) >= 0 ? -2 : -1;
+		for (unsigned int moves = map->getReverseMoves(v); moves != 0 && in != -2; moves &= moves - 1) {
+			int prev = v - map->moveOffset[__builtin_ctz(moves)];
+			if (prev == k || !isVisited(w, prev)) {
+				if (in >= 0 && in != prev) {
+					in = -2;
+					break;
+				}
+				in = prev;
+			}
+		}
+		if (in == -1) {
+			return false;
+		}
+
+		for (unsigned int moves = map->getMoves(v); moves != 0; moves &= moves - 1) {
+			int to = landing(w, v + map->moveOffset[__builtin_ctz(moves)]);
+			if (to >= 0 && to != in) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Most the route standing on k can still add before reaching the end, -1 if it can not reach the end at all
+	// A flood fill from k finds the locations a route could still move through (see passable()),
+	// and a flood fill back from the end keeps those that can still reach it.
+	// A simple route from k to the end only passes through the biconnected blocks of those locations that lie
+	// between k and the end, since leaving that chain of blocks means coming back through a location already used,
+	// so only the locations in those blocks are counted.
+	// Without portals a knight move always lands on the other color of square, so the moves left alternate
+	// colors starting with the one k is not on, and the color of the end fixes whether there are as many of each.
+	// The bound then takes only as many of the dearest locations of each color as that allows
+	int bound(Worker &w, int k) const {
+
+		w.floodGeneration += 2;
+		if (w.floodGeneration == 0) {
+			fill(w.floodStamp.begin(), w.floodStamp.end(), 0);
+			fill(w.reachStamp.begin(), w.reachStamp.end(), 0);
+			fill(w.blockStamp.begin(), w.blockStamp.end(), 0);
+			w.floodGeneration = 2;
+		}
+		uint32_t gen = w.floodGeneration;
+
+		bool reachesEnd = false;
+		w.floodStack.clear();
+		w.floodStack.push_back(k);
+		w.reachStamp[k] = gen;
+		while (!w.floodStack.empty()) {
+			int idx = w.floodStack.back();
+			w.floodStack.pop_back();
+			for (unsigned int moves = map->getMoves(idx); moves != 0; moves &= moves - 1) {
+				int land = idx + map->moveOffset[__builtin_ctz(moves)];
+				if (w.floodStamp[land] == gen) {
+					continue;
+				}
+				int to = landing(w, land);
+				if (to < 0) {
+					continue;
+				}
+				// Each location is looked at once however it is reached, and the flood carries on from where it ends up
+				w.floodStamp[land] = gen;
+				if (to == land && land != end && !passable(w, k, land)) {
+					continue;
+				}
+				w.reachStamp[land] = gen;
+				w.reachStamp[to] = gen;
+				if (to == end) {
+					reachesEnd = true;
+				}
+				else {
+					w.floodStack.push_back(to);
+				}
+			}
+		}
+		if (!reachesEnd) {
+			return -1;
+		}
+
+		// Of those, only the ones the end can still be reached from are any use.
+		// Flood back from the end through the moves into each location, re-stamping reachStamp one past.
+		// A portal entry can be stood on as well as landed on, so the ones landed on are only stamped once the flood is done
+		uint32_t back = gen + 1;
+		w.landed.clear();
+		w.floodStack.clear();
+		w.floodStack.push_back(end);
+		w.reachStamp[end] = back;
+		while (!w.floodStack.empty()) {
+			int idx = w.floodStack.back();
+			w.floodStack.pop_back();
+			if (idx == k) {
+				continue;
+			}
+
+			// Standing here means landing here or on a portal entry leading here first
+			for (int land = map->nextLanding(idx, -1); land >= 0; land = map->nextLanding(idx, land)) {
+				if (land != idx) {
+					if (w.reachStamp[land] != gen && w.reachStamp[land] != back) {
+						continue;
+					}
+					w.landed.push_back(land);
+				}
+				for (unsigned int moves = map->getReverseMoves(land); moves != 0; moves &= moves - 1) {
+					int prev = land - map->moveOffset[__builtin_ctz(moves)];
+					if (w.reachStamp[prev] == gen) {
+						w.reachStamp[prev] = back;
+						w.floodStack.push_back(prev);
+					}
+				}
+			}
+		}
+		for (size_t t = 0; t < w.landed.size(); t++) {
+			w.reachStamp[w.landed[t]] = back;
+		}
+		if (w.reachStamp[k] != back) {
+			return -1;
+		}
+
+		markBlocks(w, k);
+
+		// Locations in the blocks per color (0 is k's) and gain
+		int counts[2][256];
+		memset(counts, 0, sizeof(counts));
+		int width = map->width;
+		int color = (k % width + k / width) & 1;
+		int total = 0;
+		for (size_t v = 0; v < w.blockList.size(); v++) {
+			int c = w.blockList[v];
+			if (c != k) {
+				total += gain(c);
+				counts[((c % width + c / width) & 1) ^ color][gain(c)]++;
+			}
+		}
+		if (map->hasPortals()) {
+			return total;
+		}
+
+		int other = 0;
+		int same = 0;
+		for (int g = 0; g < 256; g++) {
+			same += counts[0][g];
+			other += counts[1][g];
+		}
+
+		// An end on k's color takes an even number of moves, half on each color, otherwise one more on the other color
+		int takeSame = (((end % width + end / width) & 1) == color) ? min(same, other) : max(0, min(same, other - 1));
+		int take[2] = {takeSame, takeSame + (((end % width + end / width) & 1) != color)};
+		total = 0;
+		for (int c = 0; c < 2; c++) {
+			for (int g = 255; g >= 0 && take[c] > 0; g--) {
+				int n = min(take[c], counts[c][g]);
+				total += n*g;
+				take[c] -= n;
+			}
+		}
+		return total;
+	}
+
+	// Next neighbor of the location of frame f among the locations the flood of bound() reached, moving f on:
+	// moves either way between them count (next 0-15), and so does a portal either way (the exit at next 16,
+	// then each portal leading to v). Returns -1 for a neighbor that is not one, -2 once there are no more
+	int blockNeighbor(const Worker &w, Frame &f) const {
+		int v = f.v;
+		int i = f.next;
+		int u;
+		if (i < 8) {
+			f.next++;
+			if (!(map->getMoves(v) & (1 << i))) {
+				return -1;
+			}
+			u = v + map->moveOffset[i];
+		}
+		else if (i < 16) {
+			f.next++;
+			if (!(map->getReverseMoves(v) & (1 << (i - 8)))) {
+				return -1;
+			}
+			u = v - map->moveOffset[i - 8];
+		}
+		else if (i == 16) {
+			f.next++;
+			f.arrival = map->getFirstArrival(v);
+			u = map->getPortalExit(v);
+			if (u < 0) {
+				return -1;
+			}
+		}
+		else {
+			if (f.arrival < 0) {
+				return -2;
+			}
+			u = map->portals[f.arrival].entry;
+			f.arrival = map->portals[f.arrival].nextArrival;
+		}
+		return w.reachStamp[u] == w.floodGeneration + 1 ? u : -1;
+	}
+
+	// Find the blocks (biconnected components, Tarjan's algorithm) of the locations the flood of bound() reached
+	// with a depth-first search from k, and list the locations of the blocks between k and the end in blockList.
+	// A block is finished off when the search backs up over the location it hangs from, and it lies between
+	// k and the end if the end was found below that
+	void markBlocks(Worker &w, int k) const {
+
+		uint32_t gen = w.floodGeneration;
+		int counter = 0;
+		w.blockList.clear();
+		w.blockStack.clear();
+		w.frames.clear();
+
+		w.blockStamp[k] = gen;
+		w.disc[k] = w.low[k] = counter++;
+		w.hasEnd[k] = (k == end);
+		w.blockStack.push_back(k);
+		Frame top = {k, 0, -1};
+		w.frames.push_back(top);
+
+		while (!w.frames.empty()) {
+
+			int v = w.frames.back().v;
+			int parent = w.frames.size() > 1 ? w.frames[w.frames.size() - 2].v : -1;
+
+			int u = blockNeighbor(w, w.frames.back());
+			if (u != -2) {
+				if (u < 0 || u == parent) {
+					continue;
+				}
+				if (w.blockStamp[u] == gen) {
+					w.low[v] = min(w.low[v], w.disc[u]);
+					continue;
+				}
+				w.blockStamp[u] = gen;
+				w.disc[u] = w.low[u] = counter++;
+				w.hasEnd[u] = (u == end);
+				w.blockStack.push_back(u);
+				Frame below = {u, 0, -1};
+				w.frames.push_back(below);
+				continue;
+			}
+
+			// Done with v, back up to its parent
+			w.frames.pop_back();
+			if (parent < 0) {
+				break;
+			}
+			w.low[parent] = min(w.low[parent], w.low[v]);
+			w.hasEnd[parent] = w.hasEnd[parent] || w.hasEnd[v];
+			if (w.low[v] >= w.disc[parent]) {
+				bool between = w.hasEnd[v];
+				do {
+					u = w.blockStack.back();
+					w.blockStack.pop_back();
+					if (between) {
+						w.blockList.push_back(u);
+					}
+				} while (u != v);
+				if (between) {
+					w.blockList.push_back(parent);
+				}
+			}
+		}
+
+		// A location joining two blocks is listed with each
+		sort(w.blockList.begin(), w.blockList.end());
+		w.blockList.erase(unique(w.blockList.begin(), w.blockList.end()), w.blockList.end());
+	}
+
+	// Keep the route in w (ending on the end) if it is the longest yet
+	void record(const Worker &w, int length) {
+		lock_guard<mutex> guard(bestLock);
+		if (length > best) {
+			best = length;
+			bestRoute = w.route;
+		}
+	}
+
+	// Extend the route in w, standing on k with the given length so far and hash of its visited set
+	void extend(Worker &w, int k, int length, uint64_t hash) {
+
+		if (timedOut) {
+			return;
+		}
+		if ((++w.nodes & 255) == 0 && chrono::steady_clock::now() > deadline) {
+			timedOut = true;
+			return;
+		}
+
+		// Seen this location and visited set before, for at least as long a route
+		uint64_t key = hash ^ zobristAt[k];
+		size_t slot = key & ((1 << MEMO_BITS) - 1);
+		if (w.memoKey[slot] == key && w.memoLength[slot] >= length) {
+			return;
+		}
+		w.memoKey[slot] = key;
+		w.memoLength[slot] = length;
+
+		int most = bound(w, k);
+		if (most < 0 || length + most <= best) {
+			return;
+		}
+
+		// Order the moves by the number of moves onward from where they end up
+		int order[8];
+		int onward[8];
+		int count = 0;
+		for (unsigned int moves = map->getMoves(k); moves != 0; moves &= moves - 1) {
+			int land = k + map->moveOffset[__builtin_ctz(moves)];
+			int to = landing(w, land);
+			if (to < 0) {
+				continue;
+			}
+			int n = 0;
+			for (unsigned int next = map->getMoves(to); next != 0; next &= next - 1) {
+				n += landing(w, to + map->moveOffset[__builtin_ctz(next)]) >= 0;
+			}
+			int c = count++;
+			while (c > 0 && onward[c-1] > n) {
+				order[c] = order[c-1];
+				onward[c] = onward[c-1];
+				c--;
+			}
+			order[c] = land;
+			onward[c] = n;
+		}
+
+		for (int m = 0; m < count; m++) {
+			int land = order[m];
+			int to = landing(w, land);
+			int next = length + gain(land);
+
+			flip(w, land);
+			w.route.push_back(land);
+			uint64_t nextHash = hash ^ zobrist[land];
+			if (to != land) {
+				flip(w, to);
+				w.route.push_back(to);
+				nextHash ^= zobrist[to];
+			}
+
+			// The route stops once it reaches the end
+			if (to == end) {
+				if (next > best) {
+					record(w, next);
+				}
+			}
+			else {
+				extend(w, to, next, nextHash);
+			}
+
+			if (to != land) {
+				flip(w, to);
+				w.route.pop_back();
+			}
+			flip(w, land);
+			w.route.pop_back();
+		}
+	}
+
+	// Split the routes out of the start into at least a few branches per thread
+	void makeBranches(Worker &w) {
+
+		Branch first;
+		first.route.assign(1, start);
+		first.length = 0;
+		first.hash = zobrist[start];
+		branches.assign(1, first);
+
+		for (int depth = 0; depth < 6 && (int)branches.size() < 8*threads; depth++) {
+
+			vector<Branch> deeper;
+			for (size_t b = 0; b < branches.size(); b++) {
+
+				// Branches that already reached the end stay as they are
+				const Branch &branch = branches[b];
+				if (branch.route.back() == end) {
+					deeper.push_back(branch);
+					continue;
+				}
+
+				for (size_t r = 0; r < branch.route.size(); r++) {
+					flip(w, branch.route[r]);
+				}
+				int k = branch.route.back();
+				for (unsigned int moves = map->getMoves(k); moves != 0; moves &= moves - 1) {
+					int land = k + map->moveOffset[__builtin_ctz(moves)];
+					int to = landing(w, land);
+					if (to < 0) {
+						continue;
+					}
+					deeper.push_back(branch);
+					deeper.back().route.push_back(land);
+					deeper.back().length += gain(land);
+					deeper.back().hash ^= zobrist[land];
+					if (to != land) {
+						deeper.back().route.push_back(to);
+						deeper.back().hash ^= zobrist[to];
+					}
+				}
+				for (size_t r = 0; r < branch.route.size(); r++) {
+					flip(w, branch.route[r]);
+				}
+			}
+			branches.swap(deeper);
+		}
+	}
+
+	void setUp(Worker &w) const {
+		int cells = map->width*map->height;
+		w.visited.assign((cells + 63) / 64, 0);
+		w.floodStamp.assign(cells, 0);
+		w.reachStamp.assign(cells, 0);
+		w.floodGeneration = 0;
+		w.blockStamp.assign(cells, 0);
+		w.disc.resize(cells);
+		w.low.resize(cells);
+		w.hasEnd.resize(cells);
+		w.memoKey.assign(1 << MEMO_BITS, 0);
+		w.memoLength.assign(1 << MEMO_BITS, -1);
+		w.nodes = 0;
+	}
+
+	// Thread loop: take branches until there are none left, following each to the end
+	void worker(Worker &w) {
+		int b;
+		while ((b = nextBranch++) < (int)branches.size()) {
+
+			const Branch &branch = branches[b];
+			w.route = branch.route;
+			for (size_t r = 0; r < branch.route.size(); r++) {
+				flip(w, branch.route[r]);
+			}
+
+			if (branch.route.back() == end) {
+				if (branch.length > best) {
+					record(w, branch.length);
+				}
+			}
+			else {
+				extend(w, branch.route.back(), branch.length, branch.hash);
+			}
+
+			for (size_t r = 0; r < branch.route.size(); r++) {
+				flip(w, branch.route[r]);
+			}
+		}
+	}
+
+public:
+
+	long long nodes; // Routes extended by the last solve()
+
+	// Use the given number of threads, or one per core if 0
+	LongestPath(int nthreads = 0) : best(-1), timedOut(false), nextBranch(0) {
+		map = NULL;
+		objective = CHEAPEST;
+		start = -1;
+		end = -1;
+		threads = nthreads;
+		if (threads <= 0) {
+			threads = thread::hardware_concurrency();
+		}
+		if (threads <= 0) {
+			threads = 1;
+		}
+		nodes = 0;
+	}
+
+	// Find the longest route on m from (startx, starty) to (endx, endy), giving up after budgetMs milliseconds
+	// Fills total_path with the locations from the end back to the start like tracePath(), and length with its
+	// cost (or moves). Returns false (and leaves total_path empty) if no route was found.
+	// exact is set if the search finished, so that no longer route exists
+	bool solve(const Map &m, int startx, int starty, int endx, int endy, double budgetMs,
+			   vector<Node> &total_path, int &length, bool &exact, Objective obj = CHEAPEST) {
+
+		map = &m;
+		objective = obj;
+		start = starty*m.width + startx;
+		end = endy*m.width + endx;
+		deadline = chrono::steady_clock::now() +
+				   chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double, milli>(budgetMs));
+		best = -1;
+		timedOut = false;
+		bestRoute.clear();
+		nodes = 0;
+		total_path.clear();
+
+		// Fixed seed so that runs are repeatable
+		int cells = m.width*m.height;
+		uint64_t seed = 0x9e3779b97f4a7c15ULL;
+		zobrist.resize(cells);
+		zobristAt.resize(cells);
+		for (int k = 0; k < cells; k++) {
+			seed = seed*6364136223846793005ULL + 1442695040888963407ULL;
+			zobrist[k] = seed ^ (seed >> 29);
+			seed = seed*6364136223846793005ULL + 1442695040888963407ULL;
+			zobristAt[k] = seed ^ (seed >> 29);
+		}
+
+		vector<Worker> workers(threads);
+		for (int t = 0; t < threads; t++) {
+			setUp(workers[t]);
+		}
+		makeBranches(workers[0]);
+		nextBranch = 0;
+
+		if (start == end) {
+			best = 0;
+			bestRoute.assign(1, start);
+		}
+		else {
+			vector<thread> pool;
+			for (int t = 1; t < threads; t++) {
+				pool.push_back(thread(&LongestPath::worker, this, ref(workers[t])));
+			}
+			worker(workers[0]);
+			for (size_t t = 0; t < pool.size(); t++) {
+				pool[t].join();
+			}
+		}
+
+		for (int t = 0; t < threads; t++) {
+			nodes += workers[t].nodes;
+		}
+		exact = !timedOut;
+		length = best;
+		for (int r = (int)bestRoute.size() - 1; r >= 0; r--) {
+			total_path.push_back(Node(bestRoute[r] % m.width, bestRoute[r] / m.width));
+		}
+		return best >= 0;
+	}
+};
+
+// One route to find on a map
+struct Query {
+
+	int startx; // Start point of the route
+	int starty;
+	int endx; // End point of the route
+	int endy;
+	Objective objective; // What the route is made cheapest in
+
+	Query() {}
+
+	Query(int sx, int sy, int ex, int ey, Objective obj = CHEAPEST) {
+		startx = sx;
+		starty = sy;
+		endx = ex;
+		endy = ey;
+		objective = obj;
+	}
+};
+
+// The answer to a Query
+struct QueryResult {
+
+	bool found; // False if there is no route (cost and route are then empty)
+	int cost; // Cost of the route, in the query's objective
+	vector<uint32_t> route; // The route as location indices (y*width + x), start first
+	SearchStats stats; // What answering the query took, including tracing the route
+	bool cached; // True if the answer came from a RouteCache, without searching
+
+	QueryResult() {
+		found = false;
+		cost = 0;
+		cached = false;
+	}
+};
+
+// What a RouteCache has done since it was made
+struct CacheStats {
+
+	long long hits; // Lookups answered by a cached route from the same start
+	long long suffixHits; // Lookups answered by the rest of a cached route that passes through the start
+	long long misses; // Lookups that found nothing
+	long long inserts; // Answers added
+	long long evictions; // Answers evicted to make room
+
+	CacheStats() {
+		hits = 0;
+		suffixHits = 0;
+		misses = 0;
+		inserts = 0;
+		evictions = 0;
+	}
+};
+
+// Bounded cache of query answers, which any number of threads can share, for traffic that asks the same routes again.
+// An answer is kept under (Map::version, start, end, objective). No two maps share a version, so one cache can front
+// searches on any number of boards, and once a map changes (setChar) its older answers are never found again, and they are evicted as room is needed. The rest of a cheapest route from any location
+// it stands on is a cheapest route from there, so each of those locations of a cached route answers queries for the
+// same end too. Holds at most maxRoutes answers and maxLocations route locations in all, evicting by CLOCK: an answer
+// used since the hand last passed it is spared once. One lock guards everything, a lookup is short next to a search
+class RouteCache {
+
+private:
+
+	// A cached answer, in slot order round the clock
+	struct Entry {
+		bool live; // False for a free slot
+		bool used; // Used since the hand last passed
+		bool found; // False if there is no route, when route is just the start
+		Objective objective;
+		uint64_t version; // Map::version it was found on
+		int end; // Location index of the end point
+		vector<uint32_t> route; // Location indices, start first, as in QueryResult
+		vector<int> costs; // Cost of the route up to each of its locations
+	};
+
+	// Index of where each location of a cached route a knight stands on can be found, chained per hash bucket
+	struct Link {
+		uint64_t version;
+		int location;
+		int end;
+		Objective objective;
+		int entry; // Slot of the answer
+		int position; // Index of the location in its route
+		int next; // Next link in the same bucket, -1 for the last
+	};
+
+	int maxRoutes;
+	size_t maxLocations;
+	vector<Entry> entries;
+	vector<int> freeEntries;
+	vector<Link> links;
+	vector<int> freeLinks;
+	vector<int> buckets; // First link in each bucket, -1 if none
+	int hand; // Slot the clock hand is on
+	int live; // Answers held
+	size_t locations; // Route locations held
+	CacheStats counts;
+	mutable mutex lock;
+
+	int bucketOf(uint64_t version, int location, int end, Objective objective) const {
+		uint64_t h = version*0x9e3779b97f4a7c15ull ^ (uint64_t)(uint32_t)location*0xc2b2ae3d27d4eb4full ^
+					 (uint64_t)(uint32_t)end*0x165667b19e3779f9ull ^ (uint64_t)objective;
+		h ^= h >> 29;
+		return (int)(h & (buckets.size() - 1));
+	}
+
+	// Link that holds the given key, -1 if none
+	int findLink(uint64_t version, int location, int end, Objective objective) const {
+		for (int l = buckets[bucketOf(version, location, end, objective)]; l >= 0; l = links[l].next) {
+			const Link &link = links[l];
+			if (link.location == location && link.end == end && link.version == version && link.objective == objective) {
+				return l;
+			}
+		}
+		return -1;
+	}
+
+	void addLink(int slot, int position) {
+		const Entry &entry = entries[slot];
+		int location = entry.route[position];
+		int l;
+		if (!freeLinks.empty()) {
+			l = freeLinks.back();
+			freeLinks.pop_back();
+		}
+		else {
+			l = links.size();
+			links.push_back(Link());
+		}
+		Link &link = links[l];
+		link.version = entry.version;
+		link.location = location;
+		link.end = entry.end;
+		link.objective = entry.objective;
+		link.entry = slot;
+		link.position = position;
+		int b = bucketOf(entry.version, location, entry.end, entry.objective);
+		link.next = buckets[b];
+		buckets[b] = l;
+	}
+
+	// Drop the answer in slot and every link to it
+	void evict(int slot) {
+		Entry &entry = entries[slot];
+		for (size_t position = 0; position < entry.route.size(); position++) {
+			int *l = &buckets[bucketOf(entry.version, entry.route[position], entry.end, entry.objective)];
+			while (*l >= 0 && !(links[*l].entry == slot && links[*l].position == (int)position)) {
+				l = &links[*l].next;
+			}
+			if (*l >= 0) {
+				int gone = *l;
+				*l = links[gone].next;
+				freeLinks.push_back(gone);
+			}
+		}
+		locations -= entry.route.size();
+		live--;
+		entry.live = false;
+		entry.route.clear();
+		entry.costs.clear();
+		freeEntries.push_back(slot);
+	}
+
+	// Whether both ends of query are on map, only those are cached (a location index off the map aliases one on it)
+	static bool onMap(const Map &map, const Query &query) {
+		return query.startx >= 0 && query.startx < map.width && query.starty >= 0 && query.starty < map.height &&
+			   query.endx >= 0 && query.endx < map.width && query.endy >= 0 && query.endy < map.height;
+	}
+
+public:
+
+	// Hold at most the given number of answers and route locations
+	RouteCache(int routes, size_t routeLocations) {
+		maxRoutes = max(routes, 1);
+		maxLocations = max(routeLocations, (size_t)1);
+		entries.resize(maxRoutes);
+		for (int slot = maxRoutes - 1; slot >= 0; slot--) {
+			entries[slot].live = false;
+			freeEntries.push_back(slot);
+		}
+		size_t size = 1;
+		while (size < 2*maxLocations) {
+			size *= 2;
+		}
+		buckets.assign(size, -1);
+		hand = 0;
+		live = 0;
+		locations = 0;
+	}
+
+	// Answer query from the cache if it can be, into result (with empty stats and cached set). Returns false if not
+	bool lookup(const Map &map, const Query &query, QueryResult &result) {
+
+		if (!onMap(map, query)) {
+			return false;
+		}
+		int start = query.starty*map.width + query.startx;
+		int end = query.endy*map.width + query.endx;
+
+		lock_guard<mutex> guard(lock);
+		int l = findLink(map.version, start, end, query.objective);
+		if (l < 0) {
+			counts.misses++;
+			return false;
+		}
+
+		Entry &entry = entries[links[l].entry];
+		int position = links[l].position;
+		entry.used = true;
+		result.found = entry.found;
+		result.cost = entry.found ? entry.costs.back() - entry.costs[position] : 0;
+		result.route.clear();
+		if (entry.found) {
+			result.route.assign(entry.route.begin() + position, entry.route.end());
+		}
+		result.stats.clear();
+		result.cached = true;
+		if (position == 0) {
+			counts.hits++;
+		}
+		else {
+			counts.suffixHits++;
+		}
+		return true;
+	}
+
+	// Keep the answer to query, found on map as it is now. Answers longer than the whole cache are not kept
+	void insert(const Map &map, const Query &query, const QueryResult &result) {
+
+		if (!onMap(map, query)) {
+			return;
+		}
+		int start = query.starty*map.width + query.startx;
+		size_t length = result.found ? result.route.size() : 1;
+		if (length == 0 || length > maxLocations) {
+			return;
+		}
+
+		lock_guard<mutex> guard(lock);
+		int end = query.endy*map.width + query.endx;
+		if (findLink(map.version, start, end, query.objective) >= 0) {
+			return;
+		}
+
+		// Go round the clock until there is room, sparing each answer used since the last time round once
+		while (live == maxRoutes || locations + length > maxLocations) {
+			Entry &entry = entries[hand];
+			if (entry.live && entry.used) {
+				entry.used = false;
+			}
+			else if (entry.live) {
+				evict(hand);
+				counts.evictions++;
+			}
+			hand = (hand + 1) % maxRoutes;
+		}
+
+		int slot = freeEntries.back();
+		freeEntries.pop_back();
+		Entry &entry = entries[slot];
+		entry.live = true;
+		entry.used = false;
+		entry.found = result.found;
+		entry.objective = query.objective;
+		entry.version = map.version;
+		entry.end = end;
+		if (result.found) {
+			entry.route = result.route;
+		}
+		else {
+			entry.route.assign(1, start);
+		}
+		live++;
+		locations += length;
+		counts.inserts++;
+
+		// Walk the route as validateRoute() does for the cost so far at each location, and link each one it stands on:
+		// every one but a portal entry landed on, which is left for its exit at once
+		entry.costs.assign(length, 0);
+		bool standing = true;
+		for (size_t k = 0; k < length; k++) {
+			int location = entry.route[k];
+			bool hop = (k > 0 && !standing && map.getPortalExit(entry.route[k-1]) == location);
+			if (k > 0) {
+				entry.costs[k] = entry.costs[k-1] + (hop ? 0 : (query.objective == FEWEST_MOVES ? 1 : map.getCost(location)));
+			}
+			standing = (k == 0 || hop || map.getPortalExit(location) < 0);
+			if (standing && (k == 0 || entry.found) && findLink(entry.version, location, end, entry.objective) < 0) {
+				addLink(slot, k);
+			}
+		}
+	}
+
+	// Drop every answer
+	void clear() {
+		lock_guard<mutex> guard(lock);
+		for (int slot = 0; slot < maxRoutes; slot++) {
+			if (entries[slot].live) {
+				evict(slot);
+			}
+		}
+	}
+
+	CacheStats getStats() const {
+		lock_guard<mutex> guard(lock);
+		return counts;
+	}
+};
+
+// Runs batches of queries against one map on a pool of threads
+// The threads are started with the first batch and parked between batches, so a stream of small batches pays
+// no thread start-up. Each thread keeps its own SearchState between batches, and the map is only ever read.
+// Queries are dealt out to the threads in contiguous blocks; a thread that runs out
+// steals single queries from the front of another thread's block, so a few slow queries
+// cannot leave the other cores idle. Results always come back in query order
+class QueryEngine {
+
+private:
+
+	// Queries waiting for one thread, the owner takes from the back and thieves from the front
+	struct WorkQueue {
+		mutex lock;
+		deque<int> items;
+	};
+
+	int threads; // Number of worker threads
+	vector<SearchState> states; // Scratch space of each worker
+	RouteCache *cache; // Answers shared between queries and batches, NULL for none
+	vector<WorkQueue> work; // Pending queries of each worker
+
+	// Workers 1 to threads - 1, parked between batches (the thread calling run() is worker 0), and the batch they are
+	// on: each is let go once a batch starts and counted off as it finishes, all under batchLock
+	vector<thread> pool;
+	mutex batchLock;
+	condition_variable batchStarted; // A batch has started, or the engine is going away
+	condition_variable batchFinished; // The last parked worker is done with the batch
+	int batches; // Batches started so far
+	int busy; // Parked workers not yet done with the current batch
+	bool stopping;
+	const Map *batchMap;
+	const vector<Query> *batchQueries;
+	vector<QueryResult> *batchResults;
+
+	// Next query for worker w: its own newest, else the oldest of the first other worker that has any
+	bool takeWork(int w, int &item) {
+		{
+			lock_guard<mutex> guard(work[w].lock);
+			if (!work[w].items.empty()) {
+				item = work[w].items.back();
+				work[w].items.pop_back();
+				return true;
+			}
+		}
+		for (int k = 1; k < threads; k++) {
+			WorkQueue &victim = work[(w + k) % threads];
+			lock_guard<mutex> guard(victim.lock);
+			if (!victim.items.empty()) {
+				item = victim.items.front();
+				victim.items.pop_front();
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Worker loop: nothing is added once a batch starts, so finding no work anywhere means it is done
+	void worker(int w, const Map &map, const vector<Query> &queries, vector<QueryResult> &results) {
+		int item;
+		while (takeWork(w, item)) {
+			runQuery(map, states[w], queries[item], results[item], cache);
+		}
+	}
+
+	// Parked worker w: wait for each batch, work on it, and report back, until the engine goes away
+	void parked(int w) {
+		int seen = 0;
+		while (true) {
+			{
+				unique_lock<mutex> guard(batchLock);
+				while (!stopping && batches == seen) {
+					batchStarted.wait(guard);
+				}
+				if (stopping) {
+					return;
+				}
+				seen = batches;
+			}
+			worker(w, *batchMap, *batchQueries, *batchResults);
+			lock_guard<mutex> guard(batchLock);
+			if (--busy == 0) {
+				batchFinished.notify_one();
+			}
+		}
+	}
+
+public:
+
+	// Use the given number of threads, or one per core if 0
+	QueryEngine(int nthreads = 0) : threads(nthreads), states(), cache(NULL), work() {
+		if (threads <= 0) {
+			threads = thread::hardware_concurrency();
+		}
+		if (threads <= 0) {
+			threads = 1;
+		}
+		states.resize(threads);
+		work = vector<WorkQueue>(threads);
+		batches = 0;
+		busy = 0;
+		stopping = false;
+		batchMap = NULL;
+		batchQueries = NULL;
+		batchResults = NULL;
+	}
+
+	// Let the parked workers go and wait for them
+	~QueryEngine() {
+		{
+			lock_guard<mutex> guard(batchLock);
+			stopping = true;
+		}
+		batchStarted.notify_all();
+		for (size_t k = 0; k < pool.size(); k++) {
+			pool[k].join();
+		}
+	}
+
+	int getThreads() const {return threads;}
+
+	// Let every search jump across uniform regions, or not (see SearchState::jumps)
+	void setJumps(bool on) {
+		for (int w = 0; w < threads; w++) {
+			states[w].jumps = on;
+		}
+	}
+
+	// Answer queries from cache where it can, and keep the answers searched for in it (NULL for none).
+	// The cache has to outlive the engine's batches
+	void setCache(RouteCache *routeCache) {
+		cache = routeCache;
+	}
+
+	// Answer one query using the given scratch space, from the cache if it has the answer
+	static void runQuery(const Map &map, SearchState &state, const Query &query, QueryResult &result,
+						 RouteCache *cache = NULL) {
+		if (cache != NULL && cache->lookup(map, query, result)) {
+			return;
+		}
+		result.cached = false;
+		result.found = search(map, state, query.startx, query.starty, query.endx, query.endy, true, query.objective);
+		result.route.clear();
+		result.cost = 0;
+		if (result.found) {
+			chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+			result.cost = state.getFinalCost();
+			result.route.resize(writeRoute(map, state, NULL, 0));
+			writeRoute(map, state, &result.route[0], result.route.size());
+			state.stats.traceMicros = chrono::duration<double, micro>(chrono::steady_clock::now() - t0).count();
+		}
+		result.stats = state.stats;
+		if (cache != NULL) {
+			cache->insert(map, query, result);
+		}
+	}
+
+	// Answer every query, results[i] is the answer to queries[i]
+	void run(const Map &map, const vector<Query> &queries, vector<QueryResult> &results) {
+
+		results.resize(queries.size());
+
+		// Deal the queries out in contiguous blocks
+		size_t block = (queries.size() + threads - 1) / threads;
+		for (int w = 0; w < threads; w++) {
+			work[w].items.clear();
+			for (size_t k = w*block; k < min(queries.size(), (w + 1)*block); k++) {
+				work[w].items.push_back(k);
+			}
+		}
+
+		// Start the parked workers on the batch, the first time round starting them, and work as worker 0 meanwhile
+		for (int w = pool.size() + 1; w < threads; w++) {
+			pool.push_back(thread(&QueryEngine::parked, this, w));
+		}
+		{
+			lock_guard<mutex> guard(batchLock);
+			batchMap = &map;
+			batchQueries = &queries;
+			batchResults = &results;
+			busy = threads - 1;
+			batches++;
+		}
+		batchStarted.notify_all();
+		worker(0, map, queries, results);
+
+		unique_lock<mutex> guard(batchLock);
+		while (busy > 0) {
+			batchFinished.wait(guard);
+		}
+	}
+};
+
+// Hash table from 64-bit keys to ints, by open addressing with linear probing, for sparse (step, location) states.
+// Its slots are flat arrays kept between uses: clear() empties only the slots in use, and it only allocates
+// when it grows past half full
+class SpaceTimeTable {
+
+private:
+
+	static const uint64_t EMPTY = ~0ull;
+
+	vector<uint64_t> keys; // EMPTY for a free slot
+	vector<int> values;
+	vector<int> filled; // Slots in use, to clear
+	size_t mask; // Number of slots minus one, a power of two
+
+	size_t slotOf(uint64_t key) const {
+		uint64_t h = key*0x9e3779b97f4a7c15ull;
+		size_t slot = (h ^ h >> 32) & mask;
+		while (keys[slot] != EMPTY && keys[slot] != key) {
+			slot = (slot + 1) & mask;
+		}
+		return slot;
+	}
+
+	void grow() {
+		vector<uint64_t> oldKeys(keys.size()*2, EMPTY);
+		vector<int> oldValues(values.size()*2);
+		oldKeys.swap(keys);
+		oldValues.swap(values);
+		mask = keys.size() - 1;
+		vector<int> oldFilled;
+		oldFilled.swap(filled);
+		for (size_t n = 0; n < oldFilled.size(); n++) {
+			size_t slot = slotOf(oldKeys[oldFilled[n]]);
+			keys[slot] = oldKeys[oldFilled[n]];
+			values[slot] = oldValues[oldFilled[n]];
+			filled.push_back(slot);
+		}
+	}
+
+public:
+
+	SpaceTimeTable() : keys(64, EMPTY), values(64), filled(), mask(63) {}
+
+	// Key of location at step
+	static uint64_t key(int step, int location) {
+		return (uint64_t)(uint32_t)step << 32 | (uint32_t)location;
+	}
+
+	// The value under key into value, false if there is none
+	bool get(uint64_t key, int &value) const {
+		size_t slot = slotOf(key);
+		if (keys[slot] == EMPTY) {
+			return false;
+		}
+		value = values[slot];
+		return true;
+	}
+
+	void set(uint64_t key, int value) {
+		if (2*(filled.size() + 1) > keys.size()) {
+			grow();
+		}
+		size_t slot = slotOf(key);
+		if (keys[slot] == EMPTY) {
+			keys[slot] = key;
+			filled.push_back(slot);
+		}
+		values[slot] = value;
+	}
+
+	size_t size() const {return filled.size();}
+
+	// Each key in use and its value, by index 0 to size() - 1
+	uint64_t keyAt(size_t n) const {return keys[filled[n]];}
+	int valueAt(size_t n) const {return values[filled[n]];}
+
+	void clear() {
+		for (size_t n = 0; n < filled.size(); n++) {
+			keys[filled[n]] = EMPTY;
+		}
+		filled.clear();
+	}
+};
+
+const uint64_t SpaceTimeTable::EMPTY;
+
+// The route a CooperativePlanner found for one agent
+struct AgentRoute {
+
+	bool found; // False if the agent has no route (cost and route are then empty)
+	int cost; // Cost of the route, in the query's objective, waiting a step costing 1
+	int arrival; // Step the agent reaches its end point, and stays on it from
+	vector<uint32_t> route; // Location indices, start first, with the portal entries landed on as in QueryResult
+	vector<int> steps; // Step each location of route is reached at: one more for each move or wait,
+					   // the same for a portal entry and its exit, and a wait repeats the location
+
+	AgentRoute() {
+		found = false;
+		cost = 0;
+		arrival = 0;
+	}
+};
+
+// What planning a set of agents took
+struct CooperativeReport {
+
+	int agents; // Agents planned
+	int routed; // Agents given a route
+	int conflicts; // Times an agent stands where another already does at the same step
+	int makespan; // Last step any agent arrives
+	long long expanded; // Space-time states expanded in all
+	double planMicros; // Time planning took
+
+	CooperativeReport() {
+		agents = 0;
+		routed = 0;
+		conflicts = 0;
+		makespan = 0;
+		expanded = 0;
+		planMicros = 0;
+	}
+};
+
+// Cooperative A* for many knights on one board, which must never stand on the same location at the same step.
+// Agents are planned one at a time in priority order (the order given), each by A* over (location, step)
+// around a reservation table of where the ones before it stand at each step. A step is a knight move, with the
+// usual move table, costs and portals, or waiting where it is for a cost of 1. An agent stays on its end point
+// once it arrives, so it can only arrive once nobody before it is due there again.
+// The estimate of the cost left is exact for a lone agent: it comes from a backward search from the end point that
+// is taken only as far as the locations asked about need (Reverse Resumable A*), so an agent with nobody in its way
+// goes straight there. An agent can take at most maxWait steps more than the cost of its route alone, and has no
+// route if it needs longer. Only the agents before it are seen, so two that start on one location conflict regardless:
+// the report counts every conflict in the routes found, from a check of its own.
+// The tables and search nodes are kept between agents and plans, so planning allocates little once warmed up
+class CooperativePlanner {
+
+public:
+
+	int maxWait; // Most steps an agent can take beyond the cost of its route alone, waiting or going round others
+
+private:
+
+	// A state reached by the search: standing on location at step, having landed on entry (-1 if none) to get there
+	struct StepNode {
+		int location;
+		int entry;
+		int step;
+		int cost;
+		int parent; // Node before, -1 for the start
+	};
+
+	SpaceTimeTable reserved; // (step, location) of each agent routed so far, to the agent
+	SpaceTimeTable lastStep; // Location to the last step any agent routed so far is on it, INT_MAX once one stays
+	SpaceTimeTable parked; // Location to the step an agent routed so far stays on it from
+	SpaceTimeTable best; // (step, location) to the node of the cheapest way found to it this search
+	vector<StepNode> nodes;
+	// Heap of (priority << 32 | cost left for a lone agent, -node): cheapest, then nearest the end point,
+	// then newest on top, which goes straight across the many states of equal priority that waiting makes
+	vector<pair<long long,int> > open;
+	SearchState toEnd; // Backward search from the end point, resumed by costToEnd()
+	long long expanded;
+
+	// Cheapest cost from location k to the end point for a lone agent, -1 if there is none
+	// The backward search goes on from where it left off until k is settled
+	int costToEnd(const Map &map, int k, Objective objective) {
+		BucketQueue &openpq = toEnd.openList;
+		while (!toEnd.isClosed(k)) {
+			if (openpq.empty()) {
+				return -1;
+			}
+			int idx = openpq.pop();
+			int cost = toEnd.getCost(idx);
+			toEnd.addToClosed(idx);
+
+			// Each location a knight can land on to end up standing here, from each location a move before it
+			for (int landing = map.nextLanding(idx, -1); landing >= 0; landing = map.nextLanding(idx, landing)) {
+				int elecost = cost + (objective == FEWEST_MOVES ? 1 : map.getCost(landing));
+				for (unsigned int moves = map.getReverseMoves(landing); moves != 0; moves &= moves - 1) {
+					int prev = landing - map.moveOffset[__builtin_ctz(moves)];
+					if (toEnd.isClosed(prev) || (toEnd.isOpen(prev) && toEnd.getCost(prev) <= elecost)) {
+						continue;
+					}
+					if (toEnd.isOpen(prev)) {
+						openpq.decrease(prev, elecost);
+					}
+					else {
+						openpq.push(prev, elecost);
+						toEnd.addToOpen(prev);
+					}
+					toEnd.setCost(prev, elecost);
+				}
+			}
+		}
+		return toEnd.getCost(k);
+	}
+
+	bool isReserved(int step, int location) const {
+		int agent;
+		if (reserved.get(SpaceTimeTable::key(step, location), agent)) {
+			return true;
+		}
+		int from;
+		return parked.get(location, from) && step >= from;
+	}
+
+	// Add the state of standing on location at step for cost, unless it is reserved (the start never is),
+	// already reached as cheaply, or has no way on to the end point. Every step costs at least 1, so arriving
+	// after step endFree costs at least as many more as there are steps to go until then
+	void reach(const Map &map, int parent, int location, int entry, int step, int cost, Objective objective, int endFree) {
+		if (parent >= 0 && isReserved(step, location)) {
+			return;
+		}
+		int rest = costToEnd(map, location, objective);
+		if (rest < 0) {
+			return;
+		}
+		uint64_t key = SpaceTimeTable::key(step, location);
+		int n;
+		if (best.get(key, n) && nodes[n].cost <= cost) {
+			return;
+		}
+		StepNode node;
+		node.location = location;
+		node.entry = entry;
+		node.step = step;
+		node.cost = cost;
+		node.parent = parent;
+		n = nodes.size();
+		nodes.push_back(node);
+		best.set(key, n);
+		open.push_back(make_pair((long long)(cost + max(rest, endFree + 1 - step)) << 32 | rest, -n));
+		push_heap(open.begin(), open.end(), greater<pair<long long,int> >());
+	}
+
+	// Plan one agent around the reservations so far
+	void planAgent(const Map &map, const Query &query, AgentRoute &result) {
+
+		result = AgentRoute();
+		if (query.startx < 0 || query.startx >= map.width || query.starty < 0 || query.starty >= map.height ||
+			query.endx < 0 || query.endx >= map.width || query.endy < 0 || query.endy >= map.height) {
+			return;
+		}
+
+		int start = query.starty*map.width + query.startx;
+		int end = query.endy*map.width + query.endx;
+		int endFree = -1;
+		int last;
+		if (lastStep.get(end, last)) {
+			endFree = last;
+		}
+		if (endFree == INT_MAX) {
+			return; // Taken for good by an agent before
+		}
+
+		// An agent with no route alone has none here either, and the cost of the one it has (at least its moves)
+		// bounds the search's steps
+		toEnd.reset(map, query.endx, query.endy, query.objective == FEWEST_MOVES ? 1 : map.maxCost);
+		toEnd.setCost(end, 0);
+		toEnd.addToOpen(end);
+		toEnd.openList.push(end, 0);
+		int alone = costToEnd(map, start, query.objective);
+		if (alone < 0) {
+			return;
+		}
+		int horizon = alone + maxWait;
+		if (endFree >= horizon) {
+			return;
+		}
+
+		nodes.clear();
+		best.clear();
+		open.clear();
+		reach(map, -1, start, -1, 0, 0, query.objective, endFree);
+
+		int goal = -1;
+		while (!open.empty() && goal < 0) {
+
+			pop_heap(open.begin(), open.end(), greater<pair<long long,int> >());
+			int n = -open.back().second;
+			open.pop_back();
+			int found;
+			if (!best.get(SpaceTimeTable::key(nodes[n].step, nodes[n].location), found) || found != n) {
+				continue; // Reached more cheaply since
+			}
+			expanded++;
+
+			StepNode node = nodes[n];
+			if (node.location == end && node.step > endFree) {
+				goal = n;
+				break;
+			}
+			if (node.step >= horizon) {
+				continue;
+			}
+
+			reach(map, n, node.location, -1, node.step + 1, node.cost + 1, query.objective, endFree);
+			for (unsigned int moves = map.getMoves(node.location); moves != 0; moves &= moves - 1) {
+				int next = node.location + map.moveOffset[__builtin_ctz(moves)];
+				int elecost = node.cost + (query.objective == FEWEST_MOVES ? 1 : map.getCost(next));
+				int exit = map.getPortalExit(next);
+				if (exit >= 0) {
+					reach(map, n, exit, next, node.step + 1, elecost, query.objective, endFree);
+				}
+				else {
+					reach(map, n, next, -1, node.step + 1, elecost, query.objective, endFree);
+				}
+			}
+		}
+		if (goal < 0) {
+			return;
+		}
+
+		// Trace the states back to the start, the entry before the exit it leads to
+		result.found = true;
+		result.cost = nodes[goal].cost;
+		result.arrival = nodes[goal].step;
+		for (int n = goal; n >= 0; n = nodes[n].parent) {
+			result.route.push_back(nodes[n].location);
+			result.steps.push_back(nodes[n].step);
+			if (nodes[n].entry >= 0) {
+				result.route.push_back(nodes[n].entry);
+				result.steps.push_back(nodes[n].step);
+			}
+		}
+		reverse(result.route.begin(), result.route.end());
+		reverse(result.steps.begin(), result.steps.end());
+	}
+
+	// Reserve where a routed agent stands at each step, and its end point from its arrival on
+	void reserve(const AgentRoute &route, int agent) {
+		for (size_t k = 0; k < route.route.size(); k++) {
+			if (k + 1 < route.route.size() && route.steps[k+1] == route.steps[k]) {
+				continue; // A portal entry, left for its exit at once
+			}
+			reserved.set(SpaceTimeTable::key(route.steps[k], route.route[k]), agent);
+			int last;
+			if (!lastStep.get(route.route[k], last) || last < route.steps[k]) {
+				lastStep.set(route.route[k], route.steps[k]);
+			}
+		}
+		parked.set(route.route.back(), route.arrival);
+		lastStep.set(route.route.back(), INT_MAX);
+	}
+
+public:
+
+	CooperativePlanner() {
+		maxWait = 64;
+		expanded = 0;
+	}
+
+	// Plan every agent, routes[a] for agents[a], and report on it all
+	CooperativeReport plan(const Map &map, const vector<Query> &agents, vector<AgentRoute> &routes) {
+
+		chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+		CooperativeReport report;
+		report.agents = agents.size();
+		reserved.clear();
+		lastStep.clear();
+		parked.clear();
+		expanded = 0;
+
+		routes.resize(agents.size());
+		for (size_t a = 0; a < agents.size(); a++) {
+			planAgent(map, agents[a], routes[a]);
+			if (routes[a].found) {
+				reserve(routes[a], a);
+				report.routed++;
+				report.makespan = max(report.makespan, routes[a].arrival);
+			}
+		}
+		report.expanded = expanded;
+		report.planMicros = chrono::duration<double, micro>(chrono::steady_clock::now() - t0).count();
+		report.conflicts = countConflicts(routes, report.makespan);
+		return report;
+	}
+
+	// Count the times a routed agent stands where another already does at the same step, up to step makespan,
+	// going by the routes alone
+	int countConflicts(const vector<AgentRoute> &routes, int makespan) {
+
+		SpaceTimeTable &standing = best;
+		standing.clear();
+		int conflicts = 0;
+		for (size_t a = 0; a < routes.size(); a++) {
+			const AgentRoute &route = routes[a];
+			if (!route.found) {
+				continue;
+			}
+			for (size_t k = 0; k < route.route.size(); k++) {
+				if (k + 1 < route.route.size() && route.steps[k+1] == route.steps[k]) {
+					continue;
+				}
+				int last = (k + 1 == route.route.size()) ? makespan : route.steps[k];
+				for (int step = route.steps[k]; step <= last; step++) {
+					uint64_t key = SpaceTimeTable::key(step, route.route[k]);
+					int count = 0;
+					standing.get(key, count);
+					conflicts += (count > 0);
+					standing.set(key, count + 1);
+				}
+			}
+		}
+		return conflicts;
+	}
+};
+
+// Read queries, one per line: startx starty endx endy [cheapest|moves]
+// Returns false on a line that cannot be read
+bool readQueries(istream &in, vector<Query> &queries) {
+
+	string line;
+	int lineNumber = 0;
+
+	while (getline(in, line)) {
+		lineNumber++;
+		istringstream fields(line);
+		Query query;
+		string objective = "cheapest";
+
+		if (!(fields >> query.startx)) {
+			continue; // Blank line
+		}
+		if (!(fields >> query.starty >> query.endx >> query.endy)) {
+			cerr << "Query line " << lineNumber << " needs startx starty endx endy\n";
+			return false;
+		}
+		fields >> objective;
+		if (objective == "cheapest") {
+			query.objective = CHEAPEST;
+		}
+		else if (objective == "moves") {
+			query.objective = FEWEST_MOVES;
+		}
+		else {
+			cerr << "Query line " << lineNumber << " has unknown objective " << objective << "\n";
+			return false;
+		}
+		queries.push_back(query);
+	}
+	return true;
+}
+
+// bench.cpp includes this file for everything but main(), with KNIGHTBOARD_NO_MAIN defined
+#ifndef KNIGHTBOARD_NO_MAIN
+
+// Print the nodes the S to E search expanded, and those a search without the heuristic did if it was run (-1 if not)
+void printExpanded(int expanded, int uninformed) {
+	cout << "Nodes Expanded: " << expanded;
+	if (uninformed >= 0) {
+		cout << " (without heuristic: " << uninformed << ")";
+	}
+	cout << "\n";
+}
+
+// Usage: knightboard [mapfile] [--queries file [--cache n]] [--agents file] [--threads n] [--field] [--bidirectional] [--clusters k] [--replan n] [--longest [ms]]
+//                   [--csv file | --binary file] [--convert board] [--stats file] [--validate file]
+//                   [--moves knight|king|camel|zebra] [--jumps] [--bitboard] [--compare]
+// The map file can be a text map or a binary board (see BoardHeader), told apart by the board's magic.
+// Reads the map from mapfile, or from stdin if none (or "-") is given.
+// With --field the cost and parent fields from the map's start to every location are printed instead,
+// found a whole cost layer at a time by a BitFrontier with --bitboard.
+// With --bidirectional the S to E route is found by searchBidirectional(), and its expansions compared.
+// With --clusters the S to E route is found through a Hierarchy of k x k clusters, and timed against search().
+// With --replan a block is dropped on the middle of the S to E route n times, and a Replanner repairs the route
+// after each, compared against a new search().
+// With --longest the longest S to E route that never visits a location twice is found instead (Level 5),
+// giving up after ms milliseconds (10 seconds by default) with the longest found by then.
+// Without --queries the map's own S to E route is searched and drawn; with it every query in
+// the file is answered, printed one per line in order as: index cost x,y x,y ... (cost -1 if there is no route)
+// With --cache the queries are answered through a RouteCache of up to n routes (and n times width + height locations),
+// repeated ones without searching, and its hits and misses printed to stderr.
+// With --agents every query in the file is an agent, and a CooperativePlanner routes them all so that no two stand on one
+// location at the same step, printed one per line as for --queries with a location per step (repeated while waiting),
+// and its report printed to stderr.
+// With --csv or --binary the S to E route is written to file in that format instead of drawn (see the top of this file),
+// which leaves nothing the size of the board to format.
+// With --convert the map is written out as a binary board, which loads much faster than the text, and nothing is searched.
+// With --validate every route in file is checked by validateRoutes() instead, one route per line as its x,y locations
+// start first (anything without a comma, like the index and cost of --queries output, is skipped), and printed one
+// per line in order as: index status cost (cost -1 unless valid), with the index of the first bad location if invalid.
+// With --jumps searches jump across uniform regions of plain ground (see SearchState::jumps), here and with --queries.
+// With --moves the S to E route is found by searchMoves() for that piece instead of a knight, and drawn.
+// With --stats the SearchStats of the S to E search, or of every query with --queries, are written to file as JSON lines.
+// With --compare the S to E route is also found by a plain uniform-cost search, and the nodes each expanded printed.
+// The benchmark of search() on generated boards is bench.cpp, built on its own.
+int main(int argc, char *argv[]) {
+
+	// Map being loaded in
+	Map map;
+	bool loaded;
+
+	const char *mapFile = "-";
+	const char *queryFile = NULL;
+	const char *agentFile = NULL;
+	int threads = 0;
+	int cacheRoutes = 0;
+	bool field = false;
+	bool bidirectional = false;
+	int clusterSize = 0;
+	int replans = 0;
+	double longestBudget = -1;
+	const char *routeFile = NULL;
+	bool binary = false;
+	const char *convertFile = NULL;
+	const char *statsFile = NULL;
+	const char *validateFile = NULL;
+	string moveSet;
+	bool jumps = false;
+	bool compare = false;
+	bool bitboard = false;
+
+	for (int a = 1; a < argc; a++) {
+		string arg = argv[a];
+		if (arg == "--queries" && a+1 < argc) {
+			queryFile = argv[++a];
+		}
+		else if (arg == "--threads" && a+1 < argc) {
+			threads = atoi(argv[++a]);
+		}
+		else if (arg == "--agents" && a+1 < argc) {
+			agentFile = argv[++a];
+		}
+		else if (arg == "--cache" && a+1 < argc) {
+			cacheRoutes = atoi(argv[++a]);
+		}
+		else if (arg == "--field") {
+			field = true;
+		}
+		else if (arg == "--bitboard") {
+			bitboard = true;
+		}
+		else if (arg == "--bidirectional") {
+			bidirectional = true;
+		}
+		else if (arg == "--clusters" && a+1 < argc) {
+			clusterSize = atoi(argv[++a]);
+		}
+		else if (arg == "--replan" && a+1 < argc) {
+			replans = atoi(argv[++a]);
+		}
+		else if ((arg == "--csv" || arg == "--binary") && a+1 < argc) {
+			routeFile = argv[++a];
+			binary = (arg == "--binary");
+		}
+		else if (arg == "--convert" && a+1 < argc) {
+			convertFile = argv[++a];
+		}
+		else if (arg == "--validate" && a+1 < argc) {
+			validateFile = argv[++a];
+		}
+		else if (arg == "--jumps") {
+			jumps = true;
+		}
+		else if (arg == "--compare") {
+			compare = true;
+		}
+		else if (arg == "--moves" && a+1 < argc) {
+			moveSet = argv[++a];
+			if (moveSet != "knight" && moveSet != "king" && moveSet != "camel" && moveSet != "zebra") {
+				cerr << "Unknown move set " << moveSet << "\n";
+				return(1);
+			}
+		}
+		else if (arg == "--stats" && a+1 < argc) {
+			statsFile = argv[++a];
+		}
+		else if (arg == "--longest") {
+			longestBudget = 10000;
+			if (a+1 < argc && isdigit(argv[a+1][0])) {
+				longestBudget = atof(argv[++a]);
+			}
+		}
+		else if (arg.size() > 1 && arg[0] == '-' && arg[1] == '-') {
+			cerr << "Unknown option " << arg << "\n";
+			return(1);
+		}
+		else {
+			mapFile = argv[a];
+		}
+	}
+
+	if (string(mapFile) != "-") {
+		ifstream file(mapFile, ios::in | ios::binary);
+		if (!file) {
+			cerr << "Could not open map file " << mapFile << "\n";
+			return(1);
+		}
+
+		// Binary boards start with their magic, anything else is read as text
+		char magic[4] = {0, 0, 0, 0};
+		file.read(magic, 4);
+		if (file.gcount() == 4 && memcmp(magic, "KBMP", 4) == 0) {
+			file.close();
+			loaded = map.loadBinary(mapFile);
+		}
+		else {
+			file.clear();
+			file.seekg(0);
+			loaded = map.load(file);
+		}
+	}
+	else {
+		loaded = map.load(cin);
+	}
+
+	if (!loaded) {
+		return(1);
+	}
+
+	// Convert mode: write the map out as a binary board and stop
+	if (convertFile != NULL) {
+		ofstream file(convertFile, ios::out | ios::binary);
+		if (!file || !map.saveBinary(file)) {
+			cerr << "Could not write board file " << convertFile << "\n";
+			return(1);
+		}
+		cout << "Board of " << map.width << "x" << map.height << " with " << map.portals.size()
+			 << " portals written to " << convertFile << "\n";
+		return(0);
+	}
+
+	// Validate mode: check every route in the file
+	if (validateFile != NULL) {
+
+		ifstream file(validateFile);
+		if (!file) {
+			cerr << "Could not open route file " << validateFile << "\n";
+			return(1);
+		}
+
+		RouteBatch batch;
+		vector<int32_t> xs;
+		vector<int32_t> ys;
+		string line;
+		while (getline(file, line)) {
+			istringstream fields(line);
+			string location;
+			xs.clear();
+			ys.clear();
+			while (fields >> location) {
+				size_t comma = location.find(',');
+				if (comma != string::npos) {
+					xs.push_back(atoi(location.c_str()));
+					ys.push_back(atoi(location.c_str() + comma + 1));
+				}
+			}
+			if (!xs.empty()) {
+				batch.add(xs.data(), ys.data(), xs.size());
+			}
+		}
+
+		vector<RouteVerdict> verdicts;
+		validateRoutes(map, batch, verdicts, threads);
+
+		string out;
+		out.reserve(1 << 16);
+		for (size_t r = 0; r < verdicts.size(); r++) {
+			out += to_string(r);
+			out += ' ';
+			out += routeStatusNames[verdicts[r].status];
+			out += ' ';
+			out += to_string(verdicts[r].status == ROUTE_VALID ? verdicts[r].cost : -1);
+			if (verdicts[r].status != ROUTE_VALID) {
+				out += " at ";
+				out += to_string(verdicts[r].failedAt);
+			}
+			out += '\n';
+			if (out.size() >= (1 << 16)) {
+				cout.write(out.data(), out.size());
+				out.clear();
+			}
+		}
+		cout.write(out.data(), out.size());
+		return(0);
+	}
+
+	// Batch mode: answer every query in the file
+	if (queryFile != NULL) {
+
+		vector<Query> queries;
+		ifstream file(queryFile);
+		if (!file) {
+			cerr << "Could not open query file " << queryFile << "\n";
+			return(1);
+		}
+		if (!readQueries(file, queries)) {
+			return(1);
+		}
+
+		QueryEngine engine(threads);
+		engine.setJumps(jumps);
+		RouteCache cache(cacheRoutes, (size_t)cacheRoutes*(map.width + map.height));
+		if (cacheRoutes > 0) {
+			engine.setCache(&cache);
+		}
+		vector<QueryResult> results;
+		engine.run(map, queries, results);
+
+		if (cacheRoutes > 0) {
+			CacheStats counts = cache.getStats();
+			cerr << "Cache: " << counts.hits << " hits, " << counts.suffixHits << " from the rest of a route, " << counts.misses
+				 << " misses, " << counts.evictions << " evictions\n";
+		}
+
+		if (statsFile != NULL) {
+			ofstream stats(statsFile);
+			for (size_t q = 0; q < results.size(); q++) {
+				results[q].stats.writeJson(stats, q, results[q].found, results[q].cost);
+			}
+			if (!stats) {
+				cerr << "Could not write stats file " << statsFile << "\n";
+				return(1);
+			}
+		}
+
+		// Format the answers into a buffer that is written out whenever it fills up
+		string out;
+		out.reserve(1 << 16);
+		for (size_t q = 0; q < results.size(); q++) {
+			out += to_string(q);
+			out += ' ';
+			out += to_string(results[q].found ? results[q].cost : -1);
+			for (size_t k = 0; k < results[q].route.size(); k++) {
+				out += ' ';
+				out += to_string(results[q].route[k] % map.width);
+				out += ',';
+				out += to_string(results[q].route[k] / map.width);
+			}
+			out += '\n';
+			if (out.size() >= (1 << 16)) {
+				cout.write(out.data(), out.size());
+				out.clear();
+			}
+		}
+		cout.write(out.data(), out.size());
+		return(0);
+	}
+
+	// Agent mode: route every query in the file at once, none standing where another does at the same step
+	if (agentFile != NULL) {
+
+		vector<Query> agents;
+		ifstream file(agentFile);
+		if (!file) {
+			cerr << "Could not open agent file " << agentFile << "\n";
+			return(1);
+		}
+		if (!readQueries(file, agents)) {
+			return(1);
+		}
+
+		CooperativePlanner planner;
+		vector<AgentRoute> routes;
+		CooperativeReport report = planner.plan(map, agents, routes);
+
+		string out;
+		for (size_t a = 0; a < routes.size(); a++) {
+			out += to_string(a);
+			out += ' ';
+			out += to_string(routes[a].found ? routes[a].cost : -1);
+			for (size_t k = 0; k < routes[a].route.size(); k++) {
+				out += ' ';
+				out += to_string(routes[a].route[k] % map.width);
+				out += ',';
+				out += to_string(routes[a].route[k] / map.width);
+			}
+			out += '\n';
+		}
+		cout.write(out.data(), out.size());
+		cerr << "Agents: " << report.routed << " of " << report.agents << " routed, " << report.conflicts << " conflicts, makespan "
+			 << report.makespan << ", " << report.expanded << " states expanded, " << report.planMicros/1000 << " ms\n";
+		return(0);
+	}
+
+	// Field mode: the cheapest cost from the start to everywhere
+	if (field) {
+
+		if (map.getStartX() < 0) {
+			cerr << "Map needs a start ('S')\n";
+			return(1);
+		}
+
+		CostField costField;
+		if (bitboard) {
+			BitFrontier frontier;
+			costField.buildLayers(map, frontier, map.getStartX(), map.getStartY());
+		}
+		else {
+			SearchState state;
+			costField.build(map, state, map.getStartX(), map.getStartY());
+		}
+
+		cout << "Cost Field:\n";
+		costField.printCostField();
+		cout << "\nParent Field:\n";
+		costField.printParentField();
+		return(0);
+	}
+
+	if (map.getStartX() < 0 || map.getEndX() < 0) {
+		cerr << "Map needs both a start ('S') and an end ('E')\n";
+		return(1);
+	}
+
+	// Longest mode: Level 5, the longest route that never visits a location twice
+	if (longestBudget >= 0) {
+
+		LongestPath longest(threads);
+		vector<Node> total_path;
+		int length;
+		bool exact;
+		chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+		bool found = longest.solve(map, map.getStartX(), map.getStartY(), map.getEndX(), map.getEndY(),
+								   longestBudget, total_path, length, exact);
+		chrono::steady_clock::time_point t1 = chrono::steady_clock::now();
+
+		if (!found) {
+			cout << "No route from the start to the end" << (exact ? "" : " found in the time budget") << "\n";
+			return(0);
+		}
+		printRoute(map, total_path, length);
+		verifySequence(total_path, map);
+		cout << "Longest Route: " << (exact ? "exact" : "longest found in the time budget") << ", "
+			 << longest.nodes << " nodes searched in " << chrono::duration<double, milli>(t1 - t0).count() << " ms\n";
+		return(0);
+	}
+
+	// Create a bad sequence of moves to test verifySequence on
+	vector<Node> test = {Node(1,1), Node(3,2), Node(4,4), Node(5,6), Node(7,8), Node(9,9), Node(10,11)};
+	
+	// Scratch space for the search, the map itself is never modified
+	SearchState state;
+
+	// Count the nodes a plain uniform-cost search expands, to compare the heuristic against (only asked for with --compare,
+	// as it is a second whole search)
+	int uninformed = -1;
+	if (compare) {
+		search(map, state, false);
+		uninformed = state.expanded;
+	}
+	state.jumps = jumps;
+
+	// Search, generate routes, plots maps, and verify for select map
+	bool reached = search(map, state);
+	if (statsFile != NULL) {
+		ofstream stats(statsFile);
+		state.stats.writeJson(stats, 0, reached, state.getFinalCost());
+		if (!stats) {
+			cerr << "Could not write stats file " << statsFile << "\n";
+			return(1);
+		}
+	}
+	if (bidirectional) {
+		int informed = state.expanded;
+
+		SearchState backward;
+		vector<Node> total_path;
+		bool found = searchBidirectional(map, state, backward, map.getStartX(), map.getStartY(),
+										 map.getEndX(), map.getEndY());
+		if (found) {
+			traceBidirectional(map, state, backward, total_path);
+		}
+		else {
+			total_path.push_back(Node(map.getStartX(), map.getStartY()));
+		}
+		printRoute(map, total_path, state.getFinalCost());
+		verifySequence(total_path, map);
+		cout << "Nodes Expanded: " << state.expanded + backward.expanded << " (forward " << state.expanded
+			 << ", backward " << backward.expanded << "; one way";
+		if (compare) {
+			cout << " without heuristic: " << uninformed << ",";
+		}
+		cout << " with heuristic: " << informed << ")\n";
+	}
+	else if (clusterSize > 0) {
+
+		// Time the hierarchy's build and query against the search above
+		Hierarchy hierarchy;
+		vector<Node> total_path;
+		chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+		hierarchy.build(map, clusterSize);
+		chrono::steady_clock::time_point t1 = chrono::steady_clock::now();
+		search(map, state);
+		chrono::steady_clock::time_point t2 = chrono::steady_clock::now();
+		int informed = state.expanded;
+		int flatCost = state.getFinalCost();
+		bool found = hierarchy.query(map, state, map.getStartX(), map.getStartY(), map.getEndX(), map.getEndY(), total_path);
+		chrono::steady_clock::time_point t3 = chrono::steady_clock::now();
+
+		if (!found) {
+			total_path.push_back(Node(map.getStartX(), map.getStartY()));
+		}
+		printRoute(map, total_path, found ? state.getFinalCost() : 0);
+		verifySequence(total_path, map);
+		cout << "Hierarchy: " << hierarchy.getClusters() << " clusters of " << hierarchy.getClusterSize() << "x"
+			 << hierarchy.getClusterSize() << ", " << hierarchy.getNodes() << " nodes, built in "
+			 << chrono::duration<double, milli>(t1 - t0).count() << " ms\n";
+		cout << "Query: " << chrono::duration<double, milli>(t3 - t2).count() << " ms, " << hierarchy.expanded
+			 << " nodes expanded" << (hierarchy.fellBack ? " (fell back to search)" : "") << "\n";
+		cout << "Search: " << chrono::duration<double, milli>(t2 - t1).count() << " ms, " << informed
+			 << " nodes expanded, cost " << flatCost << "\n";
+	}
+	else if (replans > 0) {
+
+		// The map is changed here, so work on a copy
+		Map changing = map;
+		Replanner planner;
+		vector<Node> total_path;
+		planner.plan(changing, map.getStartX(), map.getStartY(), map.getEndX(), map.getEndY());
+		bool found = planner.replan(changing);
+		cout << "Plan: cost " << planner.getCost() << ", " << planner.expanded << " nodes expanded\n";
+
+		for (int r = 0; r < replans && found; r++) {
+
+			// Block the middle of the route, skipping the ends and teleports
+			planner.getPath(changing, total_path);
+			int x = -1;
+			int y = -1;
+			for (size_t k = total_path.size()/2; k > 0 && k+1 < total_path.size(); k++) {
+				char c = changing.getChar(total_path[k].x, total_path[k].y);
+				if (c != 'S' && c != 'E' && c != 'T') {
+					x = total_path[k].x;
+					y = total_path[k].y;
+					break;
+				}
+			}
+			if (x < 0) {
+				break;
+			}
+			changing.setChar(x, y, 'B');
+			planner.cellChanged(changing, x, y);
+			found = planner.replan(changing);
+			search(changing, state, map.getStartX(), map.getStartY(), map.getEndX(), map.getEndY());
+
+			cout << "Replan " << r+1 << ": blocked (" << x << ", " << y << "), cost "
+				 << (found ? planner.getCost() : -1) << ", " << planner.expanded << " nodes expanded (search: "
+				 << state.expanded << ")\n";
+		}
+
+		if (!planner.getPath(changing, total_path)) {
+			total_path.push_back(Node(map.getStartX(), map.getStartY()));
+		}
+		cout << "\n";
+		printRoute(changing, total_path, found ? planner.getCost() : 0);
+		verifySequence(total_path, changing);
+	}
+	else if (!moveSet.empty()) {
+
+		// The same search specialized for another piece
+		SearchState pieceState;
+		int sx = map.getStartX();
+		int sy = map.getStartY();
+		int ex = map.getEndX();
+		int ey = map.getEndY();
+		bool found;
+		if (moveSet == "king") {
+			found = searchMoves<King>(map, pieceState, sx, sy, ex, ey);
+		}
+		else if (moveSet == "camel") {
+			found = searchMoves<Camel>(map, pieceState, sx, sy, ex, ey);
+		}
+		else if (moveSet == "zebra") {
+			found = searchMoves<Zebra>(map, pieceState, sx, sy, ex, ey);
+		}
+		else {
+			found = searchMoves<Knight>(map, pieceState, sx, sy, ex, ey);
+		}
+
+		vector<Node> total_path;
+		tracePath(map, pieceState, total_path);
+		printRoute(map, total_path, pieceState.getFinalCost());
+		cout << "Move Set: " << moveSet << (found ? "" : " (no route)") << ", Nodes Expanded: " << pieceState.expanded << "\n";
+	}
+	else if (routeFile != NULL) {
+
+		// Straight from the parent map into the file, start first
+		vector<uint32_t> route(writeRoute(map, state, NULL, 0));
+		writeRoute(map, state, &route[0], route.size());
+		ofstream file(routeFile, binary ? ios::out | ios::binary : ios::out);
+		if (!file || !(binary ? writeRouteBinary(file, map, &route[0], route.size(), state.getFinalCost()) :
+								writeRouteCsv(file, map, &route[0], route.size()))) {
+			cerr << "Could not write route file " << routeFile << "\n";
+			return(1);
+		}
+		cout << "Cost of Movement: " << state.getFinalCost() << "\n";
+		cout << "Route: " << route.size() << " locations written to " << routeFile << "\n";
+		printExpanded(state.expanded, uninformed);
+		return(0);
+	}
+	else {
+		verifySequence(reconstructPath(map, state), map);
+		printExpanded(state.expanded, uninformed);
+	}
+	
+	// Verify our test sequence (should return bad)
+	verifySequence(test, map);
+
+	return(0);
+}
+
+#endif